@@ -20,38 +20,234 @@
 
 #include "GenType.h"
 #include "GenTypeVisitors.h"
+#include "GCParams.h"
+#include "GCHeader.h"
+#include "Context.h"
+#include "Runtime.h"
+#include "FieldInliner.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
 
-class AccessorGenerator : public GenTypeCtxVisitor<TypeBuilder*> {
+/*!
+ * This is the context used by the accessor generator.  Each
+ * aggregate type being visited has one of these, which is linked to
+ * the context of the enclosing aggregate.  This allows the generator
+ * to reconstruct the full path from the object to any field.
+ */
+struct AccessState {
+  /*!
+   * \brief The context of the enclosing aggregate, or null.
+   */
+  const struct AccessState* up;
+  /*!
+   * \brief Position of this aggregate in the enclosing one.
+   */
+  unsigned pos;
+  /*!
+   * \brief Position of the next field in this aggregate.
+   */
+  unsigned next;
+  /*!
+   * \brief Whether this aggregate is an array.
+   */
+  bool array;
+  /*!
+   * \brief Whether this aggregate is a structure-of-arrays array.
+   */
+  bool soa;
+  /*!
+   * \brief The TBAA type node for this aggregate.
+   */
+  llvm::MDNode* tbaa;
+};
+
+/*!
+ * This is a subclass of GenTypeCtxVisitor which fills in the bodies
+ * of the accessor and modifier functions declared in the metadata.
+ *
+ * Accessors take a pointer to the object, followed by one index for
+ * each array enclosing the field (outermost first), and return the
+ * field's value.  Modifiers take the same arguments, followed by the
+ * new value.  Elements of a trailing unsized array are addressed
+ * directly in the object.  Elements of structure-of-arrays arrays
+ * are addressed by the same arguments, with the column index placed
+ * ahead of the element index.  For variable-sized types named T, a
+ * function T.length is also generated, which returns the length word.
+ *
+ * Accessors for inlined GC pointer fields return the address of the
+ * inlined object within the parent instead of loading a pointer.
+ *
+ * Loads and stores are tagged with TBAA metadata.  The TBAA type
+ * hierarchy follows the GenType structure: each realized type has a
+ * node under a common root, and each field has a node under the node
+ * for its enclosing aggregate.  All elements of an array share one
+ * node.  Accesses to distinct fields therefore never alias, while
+ * code without TBAA tags (such as the collector) aliases everything.
+ * Immutable fields get the same tags as any other field.  Their
+ * initializing stores are ordinary stores which may be inlined next to
+ * the loads, so neither constant TBAA tags nor !invariant.load would be
+ * sound for them.
+ *
+ * All generated functions are marked always-inline.
+ *
+ * \brief A visitor which generates accessor functions.
+ */
+class AccessorGenerator : public GenTypeCtxVisitor<struct AccessState> {
 private:
   llvm::Module& M;
   const GCParams& params;
+  const FieldInliner* const inliner;
+  GCHeader header;
+  Runtime runtime;
+  Context context;
 
-public:
-  AccessorGenerator(llvm::Module& M, const GCParams& params) :
-    M(M), params(params) {}
+  /*!
+   * \brief The realization of the type currently being generated.
+   */
+  llvm::StructType* realty;
+
+  /*!
+   * \brief Get the next position in an aggregate.
+   * \param parent The context of the aggregate.
+   * \return The position of the next field.
+   */
+  static inline unsigned nextPos(struct AccessState& parent) {
+    return parent.array ? 0 : parent.next++;
+  }
+
+  /*!
+   * This generates a getelementptr which computes the address of a
+   * field, pulling array indexes from the arguments of F.
+   *
+   * \brief Generate code to compute the address of a field.
+   * \param F The accessor or modifier function.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   * \param BB Basic block to which to append instructions.
+   * \return The address of the field.
+   */
+  llvm::Value* fieldAddr(llvm::Function* F,
+                         const struct AccessState& parent,
+                         unsigned pos,
+                         llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Get the TBAA type node for a field.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   * \return The TBAA type node.
+   */
+  llvm::MDNode* fieldNode(const struct AccessState& parent,
+                          unsigned pos);
 
-  virtual bool begin(const StructGenType*, TypeBuilder*&, TypeBuilder*&);
-  virtual bool begin(const FuncPtrGenType*, TypeBuilder*&, TypeBuilder*&);
-  virtual bool begin(const ArrayGenType*, TypeBuilder*&, TypeBuilder*&);
+  /*!
+   * \brief Attach TBAA metadata to a field access.
+   * \param inst The load or store instruction.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   */
+  void annotate(llvm::Instruction* inst,
+                const struct AccessState& parent,
+                unsigned pos);
+
+  /*!
+   * \brief Generate the body of an accessor function.
+   * \param F The accessor function, or null.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   */
+  void genAccess(llvm::Function* F,
+                 const struct AccessState& parent,
+                 unsigned pos);
+
+  /*!
+   * \brief Generate the body of a modifier function.
+   * \param F The modifier function, or null.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   */
+  void genModify(llvm::Function* F,
+                 const struct AccessState& parent,
+                 unsigned pos);
+
+  /*!
+   * This generates a check of whether the object has been forwarded,
+   * calling out to core.gc.readbarrier only if it has.  Null pointers
+   * are passed through as is.  Since this needs control flow, the
+   * current block is updated to the block after the check.
+   *
+   * \brief Generate a read barrier on a loaded GC pointer.
+   * \param val The GC pointer.
+   * \param BB The current basic block, which is updated.
+   * \return The current address of the object.
+   */
+  llvm::Value* readBarrier(llvm::Value* val, llvm::BasicBlock*& BB);
+
+  /*!
+   * \brief Generate the body of a GC pointer accessor function.
+   * \param gcty The GC pointer type.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   */
+  void genGCPtrAccess(const GCPtrGenType* gcty,
+                      const struct AccessState& parent,
+                      unsigned pos);
+
+  /*!
+   * \brief Generate the body of a GC pointer modifier function.
+   * \param gcty The GC pointer type.
+   * \param parent The context of the aggregate holding the field.
+   * \param pos The position of the field in the aggregate.
+   */
+  void genGCPtrModify(const GCPtrGenType* gcty,
+                      const struct AccessState& parent,
+                      unsigned pos);
+
+  /*!
+   * \brief Generate the length function for a variable-sized type.
+   * \param root The top-level context of the type being generated.
+   */
+  void genLength(const struct AccessState& root);
+
+public:
+  /*!
+   * \brief Initialize with GC params and the LLVM Module.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  AccessorGenerator(llvm::Module& M, const GCParams& params,
+                    const FieldInliner* const inliner = NULL) :
+    M(M), params(params), inliner(inliner), header(M, params),
+    runtime(M), context(M, params), realty(NULL) {}
 
-  virtual void end(const StructGenType*, TypeBuilder*&, TypeBuilder*&);
-  virtual void end(const FuncPtrGenType*, TypeBuilder*&, TypeBuilder*&);
-  virtual void end(const ArrayGenType*, TypeBuilder*&, TypeBuilder*&);
+  virtual bool begin(const StructGenType*, struct AccessState&,
+                     struct AccessState&);
+  virtual bool begin(const FuncPtrGenType*, struct AccessState&,
+                     struct AccessState&);
+  virtual bool begin(const ArrayGenType*, struct AccessState&,
+                     struct AccessState&);
 
-  virtual void visit(const NativePtrGenType*, TypeBuilder*&);
-  virtual void visit(const GCPtrGenType*, TypeBuilder*&);
-  virtual void visit(const PrimGenType*, TypeBuilder*&);
+  virtual void visit(const NativePtrGenType*, struct AccessState&);
+  virtual void visit(const GCPtrGenType*, struct AccessState&);
+  virtual void visit(const PrimGenType*, struct AccessState&);
 
   /*!
-   * This function realizes a GC type as an LLVM type by having the
-   * visitor visit the type.
+   * This function generates all accessor functions for a GC type by
+   * having the visitor visit the type.  Functions which already have
+   * bodies are left alone.
    *
-   * \brief Convert a GC type into an LLVM type.
-   * \param ty Type to convert.
-   * \param name The name of the type.
-   * \return The equivalent LLVM type.
+   * \brief Generate accessor functions for a type.
+   * \param ty Type for which to generate accessors.
+   * \param realty The realization of ty.
    */
-  virtual const llvm::Type* generate(const GenType* ty);
-}
+  virtual void generate(const GenType* ty,
+                        llvm::StructType* realty);
+};
 
 #endif
@@ -0,0 +1,86 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _ALLOC_GENERATOR_H_
+#define _ALLOC_GENERATOR_H_
+
+#include "GenType.h"
+#include "GCParams.h"
+#include "GCHeader.h"
+#include "Runtime.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+/*!
+ * This class generates allocation functions for realized GC types.
+ * An allocation function for the type named T is named T.alloc.  It
+ * takes the opaque GC context as its first argument, and (if T is
+ * variable-sized) the number of elements in the trailing array as its
+ * second.  It obtains raw memory from core.gc.rawalloc, zeroes it,
+ * fills in the header and length word, and returns a pointer to the
+ * new object.
+ *
+ * Variable-sized objects are allocated in one piece, with the trailing
+ * array stored inline.
+ *
+ * \brief Generator for GC allocation functions.
+ */
+class AllocGenerator {
+private:
+  llvm::Module& M;
+  const GCParams& params;
+  GCHeader header;
+  Runtime runtime;
+
+public:
+  /*!
+   * \brief Generate code to compute the size of an object.
+   * \param ty The type of the object.
+   * \param realty The realization of ty.
+   * \param len The length of the trailing array, or null.
+   * \param BB Basic block to which to append instructions.
+   * \return The size of the object in bytes, rounded up to its
+   *         alignment, as a 64-bit integer.
+   */
+  static llvm::Value* objSize(const GenType* ty,
+                              llvm::StructType* realty,
+                              llvm::Value* len,
+                              llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   */
+  AllocGenerator(llvm::Module& M, const GCParams& params) :
+    M(M), params(params), header(M, params), runtime(M) {}
+
+  /*!
+   * \brief Generate the allocation function for a type.
+   * \param ty The type for which to generate an allocator.
+   * \param realty The realization of ty.
+   * \param descidx The type descriptor index of ty.
+   * \param desc The type descriptor of ty.
+   * \return The allocation function.
+   */
+  llvm::Function* generate(const GenType* ty,
+                           llvm::StructType* realty,
+                           unsigned descidx,
+                           llvm::Constant* desc);
+};
+
+#endif
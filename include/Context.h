@@ -28,12 +28,184 @@
 #ifndef _CONTEXT_H_
 #define _CONTEXT_H_
 
-#include "llvm/Type.h"
-
-class GCType;
+#include "GCParams.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Value.h"
 
+/*!
+ * This class describes the layout of the GC execution context, which
+ * holds the per-thread state that generated mutator code needs to
+ * get at quickly.  It is realized as the structure core.gc.context,
+ * and the current thread's context is found through the
+ * thread-local pointer core.gc.ctx, which the runtime sets up.  The
+ * runtime functions take the same context as an i8*.
+ *
+ * If writeLogging is set, the context starts with the write log
+ * buffer, as a pointer to the next free core.gc.logentry and a
+ * pointer to the end of the buffer.  If cardMarking is set, this is
+ * followed by the card table, as an i8* which is indexed directly by
+ * an address shifted right by GCParams::cardShift.  The runtime
+ * biases it to make that work.  If satbBarriers is set, this is
+ * followed by the mark queue buffer, as a pointer to the next free
+ * i8* and a pointer to the end of the buffer, and then an i8 which is
+ * nonzero while marking is active.  Next come the start and end of
+ * the heap being collected, as two i8*s.  Copy, move, and trace
+ * functions use them to skip pointers to objects outside of it,
+ * whether scanning arrays in blocks or visiting single fields; the
+ * runtime sets them in the context it passes to those functions, and
+ * the start must never be null.  If doublePtrs is set, these are followed
+ * by an i32, 0 or 1, selecting the slot of each double pointer which
+ * belongs to the current heap.  Reads of double pointers, by mutator
+ * and collector alike, use that slot; the runtime sets it in the
+ * context it passes to copy functions to the slot being copied from.
+ * The context always ends with an i8 which the runtime sets to
+ * nonzero when it wants the thread to stop at a safepoint.
+ *
+ * \brief Layout of the GC execution context.
+ */
 class Context {
+private:
+  llvm::Module& M;
+  const GCParams& params;
+
 public:
+  /*!
+   * \brief Index of the object pointer in write log entries.
+   */
+  static const unsigned logObjIndex = 0;
+
+  /*!
+   * \brief Index of the leaf number in write log entries.
+   */
+  static const unsigned logLeafIndex = 1;
+
+  /*!
+   * \brief Index of the element number in write log entries.
+   */
+  static const unsigned logElemIndex = 2;
+
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   */
+  Context(llvm::Module& M, const GCParams& params) :
+    M(M), params(params) {}
+
+  /*!
+   * This function gets the log entry type, creating it in the module
+   * as "core.gc.logentry" if it does not already exist.  Entries are
+   * of the form { i8* obj, i32 leaf, i64 elem }, with leaves and
+   * elements as numbered by LeafEnumerator.
+   *
+   * \brief Get the type of write log entries.
+   * \return The write log entry type.
+   */
+  llvm::StructType* getLogEntryType();
+
+  /*!
+   * This function gets the context type, creating it in the module
+   * as "core.gc.context" if it does not already exist.
+   *
+   * \brief Get the type of GC execution contexts.
+   * \return The context type.
+   */
+  llvm::StructType* getType();
+
+  /*!
+   * This function gets the thread-local context pointer, creating it
+   * in the module as "core.gc.ctx" if it does not already exist.
+   *
+   * \brief Get the current thread's context pointer.
+   * \return The context pointer global.
+   */
+  llvm::GlobalVariable* getCurrent();
+
+  /*!
+   * \brief Get the index of the write log cursor in the context.
+   * \return The index of the log cursor.
+   */
+  unsigned logCurIndex() const;
+
+  /*!
+   * \brief Get the index of the write log end in the context.
+   * \return The index of the log end.
+   */
+  unsigned logEndIndex() const;
+
+  /*!
+   * \brief Get the index of the card table in the context.
+   * \return The index of the card table.
+   */
+  unsigned cardTableIndex() const;
+
+  /*!
+   * \brief Get the index of the mark queue cursor in the context.
+   * \return The index of the mark queue cursor.
+   */
+  unsigned markCurIndex() const;
+
+  /*!
+   * \brief Get the index of the mark queue end in the context.
+   * \return The index of the mark queue end.
+   */
+  unsigned markEndIndex() const;
+
+  /*!
+   * \brief Get the index of the marking active flag in the context.
+   * \return The index of the marking flag.
+   */
+  unsigned markingIndex() const;
+
+  /*!
+   * \brief Get the index of the collected heap's start in the context.
+   * \return The index of the heap start.
+   */
+  unsigned heapStartIndex() const;
+
+  /*!
+   * \brief Get the index of the collected heap's end in the context.
+   * \return The index of the heap end.
+   */
+  unsigned heapEndIndex() const;
+
+  /*!
+   * \brief Get the index of the current heap's slot in the context.
+   * \return The index of the heap slot selector.
+   */
+  unsigned heapSlotIndex() const;
+
+  /*!
+   * \brief Get the index of the safepoint request flag in the context.
+   * \return The index of the safepoint flag.
+   */
+  unsigned pollIndex() const;
+
+  /*!
+   * \brief Get the address of a context field.
+   * \param ctx Pointer to the context.
+   * \param idx Index of the field in the context.
+   * \param BB Basic block to which to append instructions.
+   * \return A pointer to the context field.
+   */
+  llvm::Value* fieldAddr(llvm::Value* ctx,
+                         unsigned idx,
+                         llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Get the address of the current heap's slot of a double
+   *        pointer.
+   * \param ctx Pointer to the context.
+   * \param ptr Pointer to the double pointer.
+   * \param BB Basic block to which to append instructions.
+   * \return A pointer to the slot.
+   */
+  llvm::Value* heapSlotAddr(llvm::Value* ctx,
+                            llvm::Value* ptr,
+                            llvm::BasicBlock* BB);
 };
 
 #endif
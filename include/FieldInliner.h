@@ -0,0 +1,89 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _FIELD_INLINER_H_
+#define _FIELD_INLINER_H_
+
+#include "GenType.h"
+#include "GCParams.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+
+/*!
+ * This class decides which GC pointer fields get inlined into their
+ * parents.  A field is inlined if inlineFields is set in the GC
+ * params, and the field is an immutable, unique, strong, mobile GC
+ * pointer to a named, fixed-size type, every field of which is
+ * immutable, that cannot reach itself through other inlined fields.
+ *
+ * An inlined field is realized as the entire realized object it would
+ * have pointed to, header included.  The collector never traces
+ * through the header, but keeping it means the pointee's own
+ * accessors work on the interior address.  Copy functions write a fresh header
+ * for each inlined object in the copy, from the pointee's type
+ * descriptor, and forward the inlined object in the source to it.
+ * Writes logged against an inlined object's address are then
+ * resolved like those to any other forwarded object.
+ *
+ * The realizer, accessor generator, and trace generators must all
+ * consult the same FieldInliner, or they will disagree on layout.
+ *
+ * \brief Policy for object inlining.
+ */
+class FieldInliner {
+private:
+  const GCParams& params;
+  const llvm::StringMap<const GenType*>& types;
+
+  /*!
+   * \brief Get the pointee type if the pointer is a candidate.
+   * \param ty The pointer type.
+   * \return The pointee type, or null if it can't be inlined.
+   */
+  const GenType* candidate(const GCPtrGenType* ty) const;
+
+  /*!
+   * \brief Check whether a type reaches a target by inlining.
+   * \param ty The type to search.
+   * \param target The type being looked for.
+   * \param visited Pointee types already searched.
+   * \return Whether target can be reached from ty.
+   */
+  bool reaches(const GenType* ty,
+               const GenType* target,
+               llvm::SmallPtrSet<const GenType*, 8>& visited) const;
+
+public:
+  /*!
+   * \brief Initialize with GC params and the map of named types.
+   * \param params The GC parameters.
+   * \param types The named GC types, as parsed from metadata.
+   */
+  FieldInliner(const GCParams& params,
+               const llvm::StringMap<const GenType*>& types) :
+    params(params), types(types) {}
+
+  /*!
+   * \brief Get the type to inline in place of a GC pointer.
+   * \param ty The GC pointer type.
+   * \return The type of the inlined object, or null if the field is
+   *         not inlined.
+   */
+  const GenType* getInlined(const GCPtrGenType* ty) const;
+};
+
+#endif
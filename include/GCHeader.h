@@ -0,0 +1,188 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _GC_HEADER_H_
+#define _GC_HEADER_H_
+
+#include "GCParams.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Value.h"
+
+/*!
+ * This class describes the layout of GC object headers, and generates
+ * code that reads and writes them.  Every realized GC object begins
+ * with a header, whose layout is determined by the GC parameters.
+ *
+ * With compact headers, the header is a single 64-bit word:
+ *
+ *   bit 0      forwarded
+ *   bit 1      mark
+ *   bits 2-5   age (generational only)
+ *   bits 32-63 type descriptor index
+ *
+ * Otherwise, the header is a structure containing a pointer to the
+ * type descriptor, a 32-bit word of flags using the same bit
+ * assignments for forwarded, mark, and age, and (if generational) a
+ * 32-bit word of generational info.
+ *
+ * Once an object has been forwarded, its header records the address
+ * of the copy.  With compact headers, the whole word becomes the
+ * forwarding address with the forwarded bit set (objects are at
+ * least word-aligned, so the low bit is free).  Otherwise, the
+ * forwarding address replaces the type descriptor pointer, which can
+ * be found in the header of the copy.
+ *
+ * With parallel copying, compact headers are forwarded with a single
+ * compare-and-swap.  Other headers can't be, as the forwarding
+ * address and the flags are separate words, so the forwarding thread
+ * claims the object by setting the busy bit in the flags, writes the
+ * forwarding address, and then publishes it by setting the forwarded
+ * bit with a release store.
+ *
+ * \brief Layout and code generation for GC object headers.
+ */
+class GCHeader {
+private:
+  llvm::Module& M;
+  const GCParams& params;
+  llvm::StructType* type;
+
+  /*!
+   * \brief Get the address of a header field.
+   * \param obj Pointer to the object.
+   * \param idx Index of the field in the header structure.
+   * \param BB Basic block to which to append instructions.
+   * \return A pointer to the header field.
+   */
+  llvm::Value* fieldAddr(llvm::Value* obj,
+                         unsigned idx,
+                         llvm::BasicBlock* BB);
+
+public:
+  /*!
+   * \brief Bit which is set when an object has been forwarded.
+   */
+  static const unsigned forwardBit = 0;
+
+  /*!
+   * \brief Bit which is set when an object has been marked.
+   */
+  static const unsigned markBit = 1;
+
+  /*!
+   * \brief Position of the lowest age bit.
+   */
+  static const unsigned ageShift = 2;
+
+  /*!
+   * \brief Number of age bits.
+   */
+  static const unsigned ageBits = 4;
+
+  /*!
+   * \brief Bit which is set while an object is being forwarded.
+   */
+  static const unsigned busyBit = 6;
+
+  /*!
+   * \brief Position of the type descriptor index in compact headers.
+   */
+  static const unsigned descShift = 32;
+
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   */
+  GCHeader(llvm::Module& M, const GCParams& params) :
+    M(M), params(params), type(NULL) {}
+
+  /*!
+   * This function gets the header type, creating it in the module as
+   * "core.gc.header" if it does not already exist.
+   *
+   * \brief Get the LLVM type of object headers.
+   * \return The header type.
+   */
+  llvm::StructType* getType();
+
+  /*!
+   * This function generates code to fill in the header of a freshly
+   * allocated object.  Compact headers record the descriptor index,
+   * all others record the descriptor pointer.  All flags and the age
+   * are cleared.
+   *
+   * \brief Generate code to initialize an object header.
+   * \param obj Pointer to the object.
+   * \param descidx The type descriptor index.
+   * \param desc The type descriptor.
+   * \param BB Basic block to which to append instructions.
+   */
+  void init(llvm::Value* obj,
+            unsigned descidx,
+            llvm::Constant* desc,
+            llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Generate code to check whether an object is forwarded.
+   * \param obj Pointer to the object.
+   * \param BB Basic block to which to append instructions.
+   * \return An i1 which is true if the object has been forwarded.
+   */
+  llvm::Value* isForwarded(llvm::Value* obj, llvm::BasicBlock* BB);
+
+  /*!
+   * This is only meaningful if the object has been forwarded.
+   *
+   * \brief Generate code to get the forwarding address of an object.
+   * \param obj Pointer to the object.
+   * \param BB Basic block to which to append instructions.
+   * \return The forwarding address, as an i8*.
+   */
+  llvm::Value* getForward(llvm::Value* obj, llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Generate code to forward an object.
+   * \param obj Pointer to the object.
+   * \param fwd Pointer to the copy of the object.
+   * \param BB Basic block to which to append instructions.
+   */
+  void setForward(llvm::Value* obj,
+                  llvm::Value* fwd,
+                  llvm::BasicBlock* BB);
+
+  /*!
+   * This generates a loop which tries to forward the object to fwd
+   * until either it succeeds, or some other thread forwards the
+   * object first.  Since this needs control flow, the current block
+   * is updated to the block after the loop.
+   *
+   * \brief Generate code to forward an object atomically.
+   * \param obj Pointer to the object.
+   * \param fwd Pointer to the copy of the object, as an i8*.
+   * \param BB The current basic block, which is updated.
+   * \return The forwarding address that won, as an i8*.
+   */
+  llvm::Value* casForward(llvm::Value* obj,
+                          llvm::Value* fwd,
+                          llvm::BasicBlock*& BB);
+};
+
+#endif
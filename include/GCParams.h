@@ -18,6 +18,8 @@
 #ifndef _GC_PARAMS_H_
 #define _GC_PARAMS_H_
 
+#include <cassert>
+
 /*!
  * This struct contains all the parameters for the GC generator.
  * These structures are intended to be constants, declared as a set of
@@ -44,6 +46,24 @@ public:
    * \param copyFuncs Whether or not to generate copy functions.
    * \param moveFuncs Whether or not to generate move functions.
    * \param traceFuncs Whether or not to generate trace functions.
+   * \param compactHeaders Whether or not to pack object headers into
+   *                       a single tagged word.
+   * \param inlineFields Whether or not to inline immutable, unique
+   *                     GC pointer fields.
+   * \param prefetchDistance How many array elements ahead to prefetch
+   *                         GC pointer targets, or zero for none.
+   * \param parallelCopy Whether or not to forward objects atomically,
+   *                     for copying with multiple GC threads.
+   * \param cardMarking Whether or not to mark cards on GC pointer
+   *                    writes.
+   * \param satbBarriers Whether or not to record overwritten GC
+   *                     pointers for concurrent marking.
+   * \param pollStride How many iterations of a counted loop to run
+   *                   between safepoint polls, or zero to poll on
+   *                   every iteration.  This must be a power of two.
+   * \param safepointBudget How many instructions may separate a
+   *                        safepoint from an earlier one for it to be
+   *                        removed, or zero to keep them all.
    */
   GCParams(const bool writeLogging,
 	   const bool readBarriers,
@@ -52,11 +72,26 @@ public:
 	   const bool doublePtrs,
 	   const bool copyFuncs,
 	   const bool moveFuncs,
-	   const bool traceFuncs) :
+	   const bool traceFuncs,
+	   const bool compactHeaders = false,
+	   const bool inlineFields = false,
+	   const unsigned prefetchDistance = 0,
+	   const bool parallelCopy = false,
+	   const bool cardMarking = false,
+	   const bool satbBarriers = false,
+	   const unsigned pollStride = 0,
+	   const unsigned safepointBudget = 0) :
     writeLogging(writeLogging), readBarriers(readBarriers),
     clusterize(clusterize), generational(generational),
     doublePtrs(doublePtrs), copyFuncs(copyFuncs),
-    moveFuncs(moveFuncs), traceFuncs(traceFuncs) {}
+    moveFuncs(moveFuncs), traceFuncs(traceFuncs),
+    compactHeaders(compactHeaders), inlineFields(inlineFields),
+    prefetchDistance(prefetchDistance), parallelCopy(parallelCopy),
+    cardMarking(cardMarking), satbBarriers(satbBarriers),
+    pollStride(pollStride), safepointBudget(safepointBudget) {
+    assert(0 == (pollStride & (pollStride - 1)) &&
+           "Poll stride must be a power of two");
+  }
 
   /*!
    * This field determines whether or not to generate write logging.
@@ -70,10 +105,13 @@ public:
   const bool writeLogging;
 
   /*!
-   * This is a placeholder at present for the (older) alternate
-   * strategy of writing through to the new heap and reading from it.
-   * I would imagine any experiment would show this to be an order of
-   * magnitude slower than write logging.
+   * This field determines whether or not to generate read barriers,
+   * the (older) alternate strategy of always working on the new copy
+   * of an object.  If set, every GC pointer loaded by an accessor is
+   * checked for a forwarded object, and the runtime is called to get
+   * the new copy if it is.  The check is a load of the header and a
+   * branch, beyond the null check.  With double pointers, this
+   * applies to the slot that gets read.
    *
    * I think Cheyney's original algorithim did this, and the
    * Cheng/Blelloch collector opted for write logging.
@@ -148,7 +186,139 @@ public:
    */
   const bool traceFuncs;
 
+  /*!
+   * This field controls the layout of object headers.  If set, the
+   * header is a single 64-bit word, with the type descriptor index
+   * in the upper half, and the age, mark, and forwarding bits packed
+   * into the lower half.  Otherwise, the header holds a pointer to
+   * the type descriptor, followed by a word of GC flags (and a word
+   * of generational info if generational is set).
+   *
+   * Compact headers limit the number of types to 2^32, but save at
+   * least one word per object.
+   *
+   * \brief Whether or not to pack object headers into a single word.
+   */
+  const bool compactHeaders;
+
+  /*!
+   * This field determines whether or not to inline objects into
+   * their parents.  If set, then any field which is an immutable,
+   * unique, strong, mobile GC pointer to a fixed-size type, all of
+   * whose fields are immutable, will be replaced with the object it
+   * references.  Accessors for such
+   * fields return the interior address of the inlined object, and
+   * trace and copy code treats it as part of the parent.
+   *
+   * \brief Whether or not to inline immutable, unique GC pointers.
+   */
+  const bool inlineFields;
+
+  /*!
+   * This field controls prefetching in trace and copy functions.  If
+   * nonzero, then the targets of all the GC pointers in an object
+   * are prefetched before any of them are visited, and loops over
+   * arrays prefetch the targets of the element this many iterations
+   * ahead.  This hides some of the latency of chasing pointers.
+   *
+   * \brief How far ahead to prefetch GC pointer targets in arrays.
+   */
+  const unsigned prefetchDistance;
+
+  /*!
+   * This field determines whether or not copy code may run on several
+   * GC threads at once.  If set, then the forwarding check uses an
+   * acquire load, and objects are forwarded by generated code with a
+   * compare-and-swap on the header.  A thread which loses the race
+   * for an object hands back its copy and uses the winner's.
+   * Otherwise, the runtime forwards objects with plain stores.
+   *
+   * \brief Whether or not to forward objects atomically.
+   */
+  const bool parallelCopy;
+
+  /*!
+   * This field determines whether or not to generate card marking
+   * write barriers.  If set, then the execution context structure
+   * will contain a pointer to the card table, and every write of a
+   * GC pointer field will store a zero (dirty) into the table entry
+   * for the card holding the start of the object.  The runtime cleans
+   * cards by setting them to anything else.  The collector finds the
+   * old-to-young pointers by tracing the objects that start on dirty
+   * cards with their trace functions.
+   *
+   * This can be used with or without write logging.
+   *
+   * \brief Whether or not to generate card marking.
+   */
+  const bool cardMarking;
+
+  /*!
+   * This field determines whether or not to generate
+   * snapshot-at-the-beginning barriers, for concurrent marking.  If
+   * set, then the execution context structure will contain a flag
+   * saying whether marking is active, and a buffer for the mark
+   * queue.  Before every write of a mutable or write-once GC pointer
+   * field, if marking is active, the old value of the field (if not
+   * null) is added to the mark queue, so that everything reachable
+   * when marking started gets marked.
+   *
+   * \brief Whether or not to generate SATB barriers.
+   */
+  const bool satbBarriers;
+
+  /*!
+   * This field controls safepoint polls in counted loops (loops with
+   * a canonical induction variable).  If nonzero, then such loops
+   * only check for a safepoint on iterations whose induction
+   * variable is a multiple of this, which costs a mask, a compare,
+   * and a well-predicted branch on the others.  Other loops poll on
+   * every iteration.  This must be zero or a power of two, so that
+   * the check needs no division.
+   *
+   * \brief Iterations between safepoint polls in counted loops.
+   */
+  const unsigned pollStride;
+
+  /*!
+   * This field controls the removal of redundant safepoint calls.  A
+   * call to the safepoint function is removed if it is preceded,
+   * within this many instructions and with no loop or call to an
+   * unknown function in between, by another safepoint.  Safepoints
+   * further apart than this are kept, to bound the time to a
+   * safepoint.
+   *
+   * \brief Instructions within which a safepoint is redundant.
+   */
+  const unsigned safepointBudget;
+
+  /*!
+   * When clusterize is set, arrays with at least this many elements
+   * (along with all unsized arrays) are traced and copied in
+   * clusters of this many elements.
+   *
+   * \brief Number of array elements in a cluster.
+   */
   static const unsigned clusterSize;
+
+  /*!
+   * When cardMarking is set, an address's card table entry is found
+   * by shifting the address right by this many bits.
+   *
+   * \brief Log base 2 of the size of a card in bytes.
+   */
+  static const unsigned cardShift;
+
+  /*!
+   * This gets the parameters given by the -core-gc-* command line
+   * options, for passes which are created by name (as by opt) and
+   * so can't be handed a GCParams.  They are built the first time
+   * this is called, which must be after the options are parsed.
+   *
+   * \brief Get the GC params given on the command line.
+   * \return The GC params given on the command line.
+   */
+  static const GCParams& fromFlags();
 };
 
 #endif
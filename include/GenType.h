@@ -99,6 +99,14 @@ private:
     return ((typeID & 0x7) << 2) | (mut & 0x3);
   }
 
+  /*!
+   * This is computed the first time hasGCPtrs is called.  It is -1
+   * until then, and 0 or 1 afterward.
+   *
+   * \brief Cached result of hasGCPtrs.
+   */
+  mutable int gcptrs;
+
 protected:
   /*!
    * \brief Single word used to store both Type ID and Mutability.
@@ -112,7 +120,7 @@ protected:
    */
   GenType(const TypeID typeID,
           const Mutability mut) :
-    flags(makeFlags(typeID, mut)) {}
+    gcptrs(-1), flags(makeFlags(typeID, mut)) {}
 
 public:
   /*!
@@ -208,6 +216,28 @@ public:
     return !(*this == other);
   }
 
+  /*!
+   * A type is variable-sized if it is an unsized array, or a
+   * structure whose last field is variable-sized.  Objects of these
+   * types carry their length in a word following the header, with
+   * the array elements stored inline at the end of the object.
+   *
+   * \brief Indicate whether this type ends in an unsized array.
+   * \return Whether this type is variable-sized.
+   */
+  bool isVariableSized() const;
+
+  /*!
+   * A type contains GC pointers if it is a GC pointer, or an
+   * aggregate with a GC pointer somewhere inside it.  Values of types
+   * which don't can be copied as raw bytes, and never need to be
+   * traced.  The result is cached, as it is asked for often.
+   *
+   * \brief Indicate whether this type contains any GC pointers.
+   * \return Whether this type contains any GC pointers.
+   */
+  bool hasGCPtrs() const;
+
 };
 
 inline std::ostream& operator<<(std::ostream& stream, const GenType& gcty) {
@@ -272,6 +302,18 @@ public:
    */
   inline llvm::Type* getLLVMType() const { return typeRef; }
 
+  /*!
+   * \brief Get the accessor function.
+   * \return The accessor function, or null if there is none.
+   */
+  inline llvm::Function* getAccessFunc() const { return accessFunc; }
+
+  /*!
+   * \brief Get the modifier function.
+   * \return The modifier function, or null if there is none.
+   */
+  inline llvm::Function* getModifyFunc() const { return modifyFunc; }
+
   /*!
    * This always returns the same object.
    *
@@ -375,6 +417,34 @@ public:
  * \brief An array in a generated type
  */
 class ArrayGenType : public GenType {
+public:
+  /*!
+   * This enumeration describes how the elements of an array are laid
+   * out in memory.
+   *
+   * \brief Enumeration for array layouts.
+   */
+  enum Layout {
+    /*!
+     * This represents an ordinary array, where each element is stored
+     * whole.
+     *
+     * \brief Array of structures.
+     */
+    AoS,
+    /*!
+     * This represents an array of flat structures which is stored as
+     * one array for each field of the structure.  It is only allowed
+     * for sized arrays whose elements are structures with no
+     * aggregate fields.
+     *
+     * \brief Structure of arrays.
+     */
+    SoA
+  };
+
+  static const char* const layoutStrs[];
+
 private:
   /*!
    * \brief The number of elements in the array.
@@ -384,6 +454,10 @@ private:
    * \brief The type of array elements.
    */
   const GenType* const elem;
+  /*!
+   * \brief The layout of the array.
+   */
+  const Layout layout;
 
   /*!
    * \brief Initialize from an element type, number of elements, and
@@ -391,11 +465,14 @@ private:
    * \param elem The element type.
    * \param nelems The number of elements (defaults to 0, indicating unsized).
    * \param The mutability (defaults to mutable).
+   * \param layout The layout (defaults to array of structures).
    */
   ArrayGenType(const GenType* elem,
                const unsigned nelems = 0,
-               const Mutability mutability = Mutable) :
-    GenType(ArrayTypeID, mutability), nelems(nelems), elem(elem) {}
+               const Mutability mutability = Mutable,
+               const Layout layout = AoS) :
+    GenType(ArrayTypeID, mutability), nelems(nelems), elem(elem),
+    layout(layout) {}
 public:
   /*!
    * \brief Structural comparison of two ArrayGenTypes.
@@ -404,7 +481,21 @@ public:
    */
   inline bool operator==(const ArrayGenType& other) const {
     return nelems == other.nelems && *elem == *other.elem &&
-      flags == other.flags;
+      flags == other.flags && layout == other.layout;
+  }
+
+  /*!
+   * \brief Get the layout of the array.
+   * \return The layout of the array.
+   */
+  inline Layout getLayout() const { return layout; }
+
+  /*!
+   * \brief Get a text description of the layout of the array.
+   * \return A text description of the layout.
+   */
+  inline const char* getLayoutName() const {
+    return layoutStrs[getLayout()];
   }
 
   /*!
@@ -697,6 +788,31 @@ public:
 
   static const char* const ptrClassStrs[];
 
+  /*!
+   * This enumeration describes whether the object referenced by a
+   * pointer may be referenced by anything else.
+   *
+   * \brief Enumeration for pointer ownership.
+   */
+  enum Ownership {
+    /*!
+     * This represents a pointer to an object that may be referenced
+     * from elsewhere.
+     *
+     * \brief Shared pointer.
+     */
+    Shared,
+    /*!
+     * This represents the only pointer to an object.  Immutable
+     * unique pointers are candidates for object inlining.
+     *
+     * \brief Unique pointer.
+     */
+    Unique
+  };
+
+  static const char* const ownershipStrs[];
+
 private:
   /*!
    * \brief The pointer class.
@@ -708,12 +824,36 @@ private:
    */
   const Mobility mobility;
 
+  /*!
+   * \brief The ownership.
+   */
+  const Ownership ownership;
+
+  /*!
+   * This should take one argument: a pointer to the top-level type,
+   * and return a value of this type.
+   *
+   * \brief Accessor function, or null.
+   */
+  llvm::Function* const accessFunc;
+
+  /*!
+   * This should be null if the mutability is Immutable.
+   *
+   * \brief Modifier function, or null.
+   */
+  llvm::Function* const modifyFunc;
+
   GCPtrGenType(llvm::Type* const Inner,
                const Mutability mutability = Mutable,
                const Mobility mobility = Mobile,
-               const PtrClass ptrclass = StrongPtr) :
+               const PtrClass ptrclass = StrongPtr,
+               const Ownership ownership = Shared,
+               llvm::Function* const accessFunc = NULL,
+               llvm::Function* const modifyFunc = NULL) :
     PtrGenType(GCPtrTypeID, Inner, mutability),
-    ptrclass(ptrclass), mobility(mobility) {}
+    ptrclass(ptrclass), mobility(mobility), ownership(ownership),
+    accessFunc(accessFunc), modifyFunc(modifyFunc) {}
 public:
 
   /*!
@@ -723,9 +863,28 @@ public:
    */
   inline bool operator==(const GCPtrGenType& other) const {
     return inner == other.inner && flags == other.flags &&
-      ptrclass == other.ptrclass && mobility == other.mobility;
+      ptrclass == other.ptrclass && mobility == other.mobility &&
+      ownership == other.ownership;
   }
 
+  inline Ownership getOwnership() const { return ownership; }
+
+  inline const char* getOwnershipName() const {
+    return ownershipStrs[getOwnership()];
+  }
+
+  /*!
+   * \brief Get the accessor function.
+   * \return The accessor function, or null if there is none.
+   */
+  inline llvm::Function* getAccessFunc() const { return accessFunc; }
+
+  /*!
+   * \brief Get the modifier function.
+   * \return The modifier function, or null if there is none.
+   */
+  inline llvm::Function* getModifyFunc() const { return modifyFunc; }
+
   inline PtrClass getPtrClass() const { return ptrclass; }
 
   inline const char* getPtrClassName() const {
@@ -0,0 +1,188 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _GLUE_GENERATOR_H_
+#define _GLUE_GENERATOR_H_
+
+#include "GenType.h"
+#include "GCParams.h"
+#include "FieldInliner.h"
+#include "TypeRealizer.h"
+#include "AllocGenerator.h"
+#include "AccessorGenerator.h"
+#include "TraceGenerator.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Module.h"
+
+/*!
+ * This class drives generation of all the GC glue code for a module.
+ * It realizes every GC type, then generates allocators, accessors,
+ * and (depending on the GC params) copy, trace, move, and sync
+ * functions for each of them.
+ *
+ * It also generates the type descriptor table, core.gc.typedescs,
+ * which the runtime uses to find out about objects.  Types are
+ * assigned descriptor indexes in order of their names.  Each entry
+ * is a core.gc.typedesc structure, containing:
+ *
+ *   i64 size       The size of the object, or for variable-sized
+ *                  objects, the offset of the trailing array.
+ *   i64 elemsize   The size of each element of the trailing array, or
+ *                  zero for fixed-size objects.
+ *   copy           The copy function, or null.
+ *   trace          The trace function, or null.  Types with no GC
+ *                  pointers all share core.gc.notrace.
+ *   i64 clusterlen The number of elements in the clustered array, or
+ *                  zero if it is unsized (in which case the length
+ *                  word gives the number) or there is none.
+ *   copycluster    The cluster-range copy function, or null if the
+ *                  type has no clustered array.
+ *   tracecluster   The cluster-range trace function, or null if the
+ *                  type has no clustered array with GC pointers.
+ *   sync           The sync function, or null if write logging is off.
+ *   move           The move function, or null.
+ *
+ * If write logging is on, it also generates core.gc.compactlog (see
+ * SyncCodeGen::generateCompact), which the runtime should run on the
+ * write log before syncing.
+ *
+ * When the cluster-range functions are present, the whole-object
+ * functions leave out the clustered array, and the collector must
+ * cover it by calling the cluster-range functions on ranges of at
+ * most GCParams::clusterSize elements.
+ *
+ * \brief Driver for GC glue code generation.
+ */
+class GlueGenerator {
+private:
+  llvm::Module& M;
+  const GCParams& params;
+  const llvm::StringMap<const GenType*>& types;
+  FieldInliner inliner;
+  TypeRealizer realizer;
+  AllocGenerator allocs;
+  AccessorGenerator accessors;
+  CopyCodeGen copies;
+  TraceCodeGen traces;
+  SyncCodeGen syncs;
+  MoveCodeGen moves;
+
+  /*!
+   * \brief The descriptor index of each named type.
+   */
+  llvm::StringMap<unsigned> descidxs;
+
+  /*!
+   * This function gets the descriptor type, creating it in the module
+   * as "core.gc.typedesc" if it does not already exist.
+   *
+   * \brief Get the type of type descriptors.
+   * \return The type descriptor type.
+   */
+  llvm::StructType* getDescType();
+
+  /*!
+   * \brief Build the type descriptor for a type.
+   * \param ty The type.
+   * \param realty The realization of ty.
+   * \param copyfn The copy function for ty, or null.
+   * \param tracefn The trace function for ty, or null.
+   * \param copyclusterfn The cluster-range copy function, or null.
+   * \param traceclusterfn The cluster-range trace function, or null.
+   * \param syncfn The sync function for ty, or null.
+   * \param movefn The move function for ty, or null.
+   * \return The type descriptor.
+   */
+  llvm::Constant* descriptor(const GenType* ty,
+                             llvm::StructType* realty,
+                             llvm::Function* copyfn,
+                             llvm::Function* tracefn,
+                             llvm::Function* copyclusterfn,
+                             llvm::Function* traceclusterfn,
+                             llvm::Function* syncfn,
+                             llvm::Function* movefn);
+
+public:
+  /*!
+   * \brief Index of the object size in type descriptors.
+   */
+  static const unsigned sizeIndex = 0;
+
+  /*!
+   * \brief Index of the trailing element size in type descriptors.
+   */
+  static const unsigned elemSizeIndex = 1;
+
+  /*!
+   * \brief Index of the copy function in type descriptors.
+   */
+  static const unsigned copyIndex = 2;
+
+  /*!
+   * \brief Index of the trace function in type descriptors.
+   */
+  static const unsigned traceIndex = 3;
+
+  /*!
+   * \brief Index of the clustered array length in type descriptors.
+   */
+  static const unsigned clusterLenIndex = 4;
+
+  /*!
+   * \brief Index of the cluster-range copy function in type descriptors.
+   */
+  static const unsigned copyClusterIndex = 5;
+
+  /*!
+   * \brief Index of the cluster-range trace function in type descriptors.
+   */
+  static const unsigned traceClusterIndex = 6;
+
+  /*!
+   * \brief Index of the sync function in type descriptors.
+   */
+  static const unsigned syncIndex = 7;
+
+  /*!
+   * \brief Index of the move function in type descriptors.
+   */
+  static const unsigned moveIndex = 8;
+
+  /*!
+   * \brief Initialize with the LLVM Module, GC params, and GC types.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param types The named GC types, as parsed from metadata.
+   */
+  GlueGenerator(llvm::Module& M,
+                const GCParams& params,
+                const llvm::StringMap<const GenType*>& types) :
+    M(M), params(params), types(types), inliner(params, types),
+    realizer(M, params, &inliner), allocs(M, params),
+    accessors(M, params, &inliner), copies(M, params, &inliner),
+    traces(M, params, &inliner), syncs(M, params, &inliner),
+    moves(M, params, &inliner) {}
+
+  /*!
+   * \brief Generate all glue code for the module.
+   */
+  void generate();
+};
+
+#endif
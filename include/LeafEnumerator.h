@@ -0,0 +1,114 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _LEAF_ENUMERATOR_H_
+#define _LEAF_ENUMERATOR_H_
+
+#include <vector>
+#include "GenType.h"
+#include "FieldInliner.h"
+#include "llvm/ADT/SmallVector.h"
+
+/*!
+ * \brief A step in the path from an object to one of its leaves.
+ */
+struct LeafStep {
+  /*!
+   * \brief Whether this step indexes an array.
+   */
+  bool array;
+
+  /*!
+   * \brief The field index, or for arrays, the number of elements.
+   */
+  unsigned idx;
+};
+
+/*!
+ * \brief A scalar field of an object, and the path to it.
+ */
+struct Leaf {
+  /*!
+   * \brief The type of the field.
+   */
+  const GenType* ty;
+
+  /*!
+   * A field inside an immutable (write-once) aggregate is immutable
+   * (write-once) itself, whatever its own type says.
+   *
+   * \brief The effective mutability of the field.
+   */
+  GenType::Mutability mutability;
+
+  /*!
+   * The path starts from a pointer to the realized object, so the
+   * first two steps are always 0 and the body index.  Array steps
+   * take their index from the element number.
+   *
+   * \brief The getelementptr indexes of the field.
+   */
+  llvm::SmallVector<LeafStep, 8> path;
+};
+
+/*!
+ * This class numbers the scalar fields (leaves) of a GC type, as used
+ * by write logging.  Leaves are numbered from zero in the order they
+ * appear in the realized body, looking through inlined objects, with
+ * each array contributing the leaves of its element type once (for
+ * structure-of-arrays, once per column).  Elements of arrays are
+ * identified separately, by the row-major index of the element
+ * within all of the arrays enclosing the leaf.
+ *
+ * Anything which writes or reads write log entries must number leaves
+ * with this class, so that they agree with each other.
+ *
+ * \brief Numbering of the leaves of GC types.
+ */
+class LeafEnumerator {
+private:
+  const FieldInliner* const inliner;
+
+  /*!
+   * \brief Add the leaves of a type.
+   * \param ty The type.
+   * \param path The path to a value of type ty.
+   * \param mut The effective mutability of the enclosing aggregate.
+   * \param out The leaves, to which to append.
+   */
+  void enumerate(const GenType* ty,
+                 llvm::SmallVectorImpl<LeafStep>& path,
+                 GenType::Mutability mut,
+                 std::vector<Leaf>& out) const;
+
+public:
+  /*!
+   * \brief Initialize with the object inlining policy.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  LeafEnumerator(const FieldInliner* const inliner = NULL) :
+    inliner(inliner) {}
+
+  /*!
+   * \brief Get the leaves of an object type.
+   * \param ty The type of the object.
+   * \param out The leaves, indexed by leaf number.
+   */
+  void enumerate(const GenType* ty, std::vector<Leaf>& out) const;
+};
+
+#endif
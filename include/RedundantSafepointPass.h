@@ -0,0 +1,84 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _REDUNDANT_SAFEPOINT_PASS_H_
+#define _REDUNDANT_SAFEPOINT_PASS_H_
+
+#include "GCParams.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+/*!
+ * This pass removes calls to the safepoint function (core.gc.safepoint)
+ * which closely follow another safepoint.  A call is redundant if,
+ * walking backward from it through straight-line code (following a
+ * block to its predecessor only when it has just one, so no loop can
+ * be in between), another safepoint is found within
+ * GCParams::safepointBudget instructions, not counting debug info
+ * intrinsics.  Only calls to the safepoint function count as
+ * safepoints.  A call to any other function, other than an
+ * intrinsic, stops the walk, as it could run for any amount of time.
+ * That includes functions using a GC strategy, as SafepointPass
+ * leaves the entry poll out of those that don't need one.
+ *
+ * This is for safepoint calls placed by the front end.  It should run
+ * before SafepointPass, whose polls only call the safepoint function
+ * on their slow path.
+ *
+ * \brief A pass to remove redundant safepoints.
+ */
+struct RedundantSafepointPass : public llvm::FunctionPass {
+private:
+  const GCParams& params;
+
+  /*!
+   * \brief Check whether an instruction is a safepoint.
+   * \param I The instruction.
+   * \param safepoint The safepoint function.
+   * \return Whether I is a safepoint.
+   */
+  static bool isSafepoint(const llvm::Instruction* I,
+                          const llvm::Function* safepoint);
+
+  /*!
+   * \brief Check whether a safepoint call closely follows another.
+   * \param call The safepoint call.
+   * \return Whether call is redundant.
+   */
+  bool redundant(const llvm::CallInst* call) const;
+
+public:
+  static char ID;
+
+  /*!
+   * \brief Initialize with the GC params.
+   * \param params The GC parameters.
+   */
+  RedundantSafepointPass(const GCParams& params) :
+    llvm::FunctionPass(ID), params(params) {}
+
+  /*!
+   * \brief Initialize with the GC params given on the command line.
+   */
+  RedundantSafepointPass() :
+    llvm::FunctionPass(ID), params(GCParams::fromFlags()) {}
+
+  virtual bool runOnFunction(llvm::Function& F);
+};
+
+#endif
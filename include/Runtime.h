@@ -0,0 +1,194 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _RUNTIME_H_
+#define _RUNTIME_H_
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+/*!
+ * This class declares the runtime functions which generated code
+ * calls into.  Each function is declared in the module the first time
+ * it is asked for.  All of them take the opaque GC context as their
+ * first argument.
+ *
+ * The runtime functions are:
+ *
+ *   i8* core.gc.rawalloc(i8* ctx, i64 size)
+ *     Allocate size bytes of uninitialized memory.
+ *
+ *   i8* core.gc.evacuate(i8* ctx, i8* obj)
+ *     Copy obj into the destination heap, forward it, queue the copy
+ *     to be scanned, and return the copy.  The header and length word
+ *     of the copy are filled in by the runtime; the body is filled in
+ *     by the object's copy function when the copy is scanned.
+ *
+ *   i8* core.gc.reserve(i8* ctx, i8* obj)
+ *     Allocate a copy of obj in the destination heap and fill in its
+ *     header and length word, without forwarding or queueing obj.
+ *     This is used instead of core.gc.evacuate for parallel copying,
+ *     where generated code does the forwarding.
+ *
+ *   void core.gc.enqueue(i8* ctx, i8* copy)
+ *     Queue a reserved copy to be scanned, once it has been
+ *     installed as the forwarding address.
+ *
+ *   void core.gc.unreserve(i8* ctx, i8* copy)
+ *     Give back a reserved copy, after another thread has forwarded
+ *     the object first.
+ *
+ *   void core.gc.mark(i8* ctx, i8* obj)
+ *     Mark obj and queue it to be traced, if it is not already
+ *     marked.
+ *
+ *   void core.gc.logfull(i8* ctx)
+ *     Hand off the entries in the context's write log buffer, and
+ *     reset the buffer so there is room for at least one more.  This
+ *     is only called when the buffer is full.  The runtime must not
+ *     sync the handed-off entries before the next safepoint.  Write
+ *     barriers skip entries already logged since the last safepoint,
+ *     so syncing early would lose any later writes to those fields.
+ *
+ *   void core.gc.markfull(i8* ctx)
+ *     Hand off the entries in the context's mark queue buffer, and
+ *     reset the buffer so there is room for at least one more.  This
+ *     is only called when the buffer is full.
+ *
+ *   void core.gc.safepoint(i8* ctx)
+ *     Stop for whatever the collector needs.  This is only called
+ *     from safepoint polls, when the context's safepoint flag is set.
+ *
+ *   i8* core.gc.readbarrier(i8* ctx, i8* obj)
+ *     Get the current copy of obj, which has been forwarded.  The
+ *     runtime may do more work here, such as copying anything obj
+ *     points to.  This is only called from read barriers, when the
+ *     inline check finds the object forwarded.
+ *
+ *   i8* core.gc.relocate(i8* ctx, i8* obj)
+ *     Look up the address obj will have once compaction is done, in
+ *     the runtime's relocation map.  Objects which don't move are
+ *     returned as is.  This must keep working after the object at
+ *     obj has been moved.
+ *
+ *   void core.gc.weakref(i8* ctx, i8* field)
+ *     Remember a GC pointer field of a copy which holds a soft, weak,
+ *     finalizer, or phantom pointer to an object that had not been
+ *     copied when the field was copied.  Once tracing is done, the
+ *     runtime must revisit every remembered field.  If the referent
+ *     has been forwarded since, the field gets the forwarding address.
+ *     If it was neither copied nor marked, it is dead, and the runtime
+ *     deals with it as the pointer class requires, normally by
+ *     clearing the field.
+ *     With double pointers, both slots of the field must be updated.
+ *
+ * \brief Declarations of GC runtime functions.
+ */
+class Runtime {
+private:
+  llvm::Module& M;
+
+  /*!
+   * \brief Get a function, declaring it if necessary.
+   * \param name The name of the function.
+   * \param functy The type of the function.
+   * \return The function.
+   */
+  llvm::Function* getFunc(const char* name, llvm::FunctionType* functy);
+
+public:
+  /*!
+   * \brief Initialize with the LLVM Module.
+   * \param M The LLVM Module.
+   */
+  Runtime(llvm::Module& M) : M(M) {}
+
+  /*!
+   * \brief Get the raw allocator function.
+   * \return The raw allocator function.
+   */
+  llvm::Function* getRawAlloc();
+
+  /*!
+   * \brief Get the evacuation function.
+   * \return The evacuation function.
+   */
+  llvm::Function* getEvacuate();
+
+  /*!
+   * \brief Get the copy reservation function.
+   * \return The copy reservation function.
+   */
+  llvm::Function* getReserve();
+
+  /*!
+   * \brief Get the copy enqueueing function.
+   * \return The copy enqueueing function.
+   */
+  llvm::Function* getEnqueue();
+
+  /*!
+   * \brief Get the function which gives back a reserved copy.
+   * \return The copy unreservation function.
+   */
+  llvm::Function* getUnreserve();
+
+  /*!
+   * \brief Get the mark function.
+   * \return The mark function.
+   */
+  llvm::Function* getMark();
+
+  /*!
+   * \brief Get the relocation lookup function.
+   * \return The relocation lookup function.
+   */
+  llvm::Function* getRelocate();
+
+  /*!
+   * \brief Get the write log overflow function.
+   * \return The write log overflow function.
+   */
+  llvm::Function* getLogFull();
+
+  /*!
+   * \brief Get the read barrier slow path function.
+   * \return The read barrier slow path function.
+   */
+  llvm::Function* getReadBarrier();
+
+  /*!
+   * \brief Get the mark queue overflow function.
+   * \return The mark queue overflow function.
+   */
+  llvm::Function* getMarkFull();
+
+  /*!
+   * \brief Get the safepoint function.
+   * \return The safepoint function.
+   */
+  llvm::Function* getSafepoint();
+
+  /*!
+   * \brief Get the weak reference recording function.
+   * \return The weak reference recording function.
+   */
+  llvm::Function* getWeakRef();
+};
+
+#endif
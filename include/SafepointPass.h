@@ -0,0 +1,118 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _SAFEPOINT_PASS_H_
+#define _SAFEPOINT_PASS_H_
+
+#include "GCParams.h"
+#include "Context.h"
+#include "Runtime.h"
+#include "llvm/Pass.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+
+/*!
+ * This pass inserts safepoint polls at the entry of every function
+ * and on every loop back edge, so that a thread asked to stop will
+ * get to a safepoint in bounded time.  Functions with no loops and
+ * no calls other than intrinsics run in bounded time anyway, so they
+ * get no entry poll; their callers' polls cover them.  A poll is
+ * inlined: it loads the safepoint flag from the current thread's
+ * context, and calls core.gc.safepoint only if the flag is set.
+ *
+ * In a counted loop (one with a canonical induction variable), the
+ * poll is skipped unless the induction variable is a multiple of
+ * GCParams::pollStride, if that is nonzero.  That keeps the load of
+ * the flag out of most iterations, while still bounding the time to
+ * a safepoint.  The stride is a power of two, so the check is a mask
+ * rather than a division.
+ *
+ * Only functions which use a GC strategy get polls; the functions
+ * generated for the collector itself don't.  This should run before
+ * WriteBarrierPass, so that barrier elision sees the polls.
+ *
+ * \brief A pass to insert safepoint polls.
+ */
+struct SafepointPass : public llvm::FunctionPass {
+private:
+  const GCParams& params;
+
+  /*!
+   * \brief Generate a safepoint poll.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param BB Basic block to which to append the poll.
+   * \param contBB Basic block to branch to afterward.
+   */
+  void poll(Context& context,
+            Runtime& runtime,
+            llvm::BasicBlock* BB,
+            llvm::BasicBlock* contBB);
+
+  /*!
+   * \brief Insert a safepoint poll before an instruction.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param I The instruction.
+   * \param iv The induction variable for strided polling, or null.
+   */
+  void pollBefore(Context& context,
+                  Runtime& runtime,
+                  llvm::Instruction* I,
+                  llvm::Value* iv);
+
+  /*!
+   * \brief Insert safepoint polls on the back edges of a loop.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param L The loop.
+   */
+  void pollLoop(Context& context,
+                Runtime& runtime,
+                llvm::Loop* L);
+
+  /*!
+   * \brief Check whether a function calls nothing but intrinsics.
+   * \param F The function.
+   * \return Whether F calls nothing but intrinsics.
+   */
+  static bool isLeaf(llvm::Function& F);
+
+public:
+  static char ID;
+
+  /*!
+   * \brief Initialize with the GC params.
+   * \param params The GC parameters.
+   */
+  SafepointPass(const GCParams& params) :
+    llvm::FunctionPass(ID), params(params) {}
+
+  /*!
+   * \brief Initialize with the GC params given on the command line.
+   */
+  SafepointPass() :
+    llvm::FunctionPass(ID), params(GCParams::fromFlags()) {}
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage& AU) const;
+
+  virtual bool runOnFunction(llvm::Function& F);
+};
+
+#endif
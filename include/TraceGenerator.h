@@ -19,6 +19,14 @@
 #define _TRACE_GENERATOR_H_
 
 #include "GenTypeVisitors.h"
+#include "GCParams.h"
+#include "GCHeader.h"
+#include "Context.h"
+#include "FieldInliner.h"
+#include "LeafEnumerator.h"
+#include "Runtime.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Instructions.h"
@@ -45,10 +53,14 @@
  * reflects the old.
  */
 
+// The len and exit members are only meaningful for array contexts
+// with a loop index.
 struct IndexState {
   llvm::Value* src;
   llvm::Value* dst;
   llvm::PHINode* loopidx;
+  llvm::Value* len;
+  llvm::BasicBlock* exit;
   unsigned idx;
 };
 
@@ -65,36 +77,266 @@ struct IndexState {
  */
 class CopyGCTraceGen : public GenTypeCtxVisitor<struct IndexState> {
 protected:
+  llvm::Module& M;
+  const GCParams& params;
+
   /*!
    * \brief The current GC context value.
    */
-  llvm::Value* const gcctx;
+  llvm::Value* gcctx;
 
   /*!
    * \brief The current basic block.
    */
   llvm::BasicBlock* BB;
+
+  /*!
+   * Unsized arrays get their length from the length word of this
+   * object.
+   *
+   * \brief The source object currently being traversed.
+   */
+  llvm::Value* srcobj;
+
+  /*!
+   * Inlined GC pointer fields are traversed as part of the parent,
+   * rather than being handed to the visit functions.
+   *
+   * \brief The object inlining policy, or null for none.
+   */
+  const FieldInliner* const inliner;
+
+  /*!
+   * When clustering, this array is left out of whole-object
+   * traversals, and handled by cluster-range functions instead.
+   *
+   * \brief The clustered array of the current type, or null.
+   */
+  const ArrayGenType* clustered;
+
+  /*!
+   * This runs the visitor over the body of an object, appending code
+   * to the current basic block.  The gcctx and BB members must be set
+   * up beforehand.
+   *
+   * \brief Generate code to traverse an object.
+   * \param ty The type of the object.
+   * \param src Pointer to the source object.
+   * \param dst Pointer to the destination object.
+   */
+  void traverse(const GenType* ty, llvm::Value* src, llvm::Value* dst);
+
+  /*!
+   * Outside of array loops, this generates getelementptrs for the
+   * next field in the aggregate.  Inside array loops, the context
+   * already holds the element addresses.
+   *
+   * \brief Get the source and destination addresses of the next field.
+   * \param BB Basic block to which to append instructions.
+   * \param ctx The context of the enclosing aggregate.
+   * \param src Set to the source address.
+   * \param dst Set to the destination address.
+   */
+  static void getSrcDst(llvm::BasicBlock* BB,
+                        struct IndexState& ctx,
+                        llvm::Value*& src,
+                        llvm::Value*& dst);
+
+  /*!
+   * This generates a loop which runs the visitor over elements
+   * [start, end) of the clustered array of an object.  Empty ranges
+   * skip the loop entirely.
+   *
+   * \brief Generate code to traverse part of the clustered array.
+   * \param ty The type of the object.
+   * \param src Pointer to the source object.
+   * \param dst Pointer to the destination object.
+   * \param start The first element, as a 64-bit integer.
+   * \param end One past the last element, as a 64-bit integer.
+   */
+  void traverseRange(const GenType* ty,
+                     llvm::Value* src,
+                     llvm::Value* dst,
+                     llvm::Value* start,
+                     llvm::Value* end);
+
+  /*!
+   * \brief Get the number of elements in an array.
+   * \param gcty The array type.
+   * \return The length, as a 64-bit integer.
+   */
+  llvm::Value* arrayLength(const ArrayGenType* gcty);
+
+  /*!
+   * This ends the current block with a branch to a new loop block,
+   * which becomes the current block.  Unless the bounds are constants
+   * which guarantee at least one iteration, the branch is guarded by
+   * a check which skips straight to an exit block.
+   *
+   * \brief Start a loop.
+   * \param start The initial value of the loop index.
+   * \param len The loop bound, as a 64-bit integer.
+   * \param exitBB Set to the exit block, or null if there is no guard.
+   * \return The loop index variable.
+   */
+  llvm::PHINode* beginLoop(llvm::Value* start,
+                           llvm::Value* len,
+                           llvm::BasicBlock*& exitBB);
+
+  /*!
+   * This increments the loop index, and branches back to the start of
+   * the loop if it is less than the length.  The exit block (or a new
+   * block, if the loop had no guard) becomes the current block.
+   *
+   * \brief End a loop started by beginLoop.
+   * \param loopidx The loop index variable.
+   * \param len The loop bound, as a 64-bit integer.
+   * \param exitBB The exit block from beginLoop.
+   */
+  void endLoop(llvm::PHINode* loopidx,
+               llvm::Value* len,
+               llvm::BasicBlock* exitBB);
+
+  /*!
+   * This loads each strong GC pointer in a value (including those in
+   * inlined objects, but not those in arrays), and prefetches its
+   * target.  Prefetches never fault, so null pointers are fine.
+   *
+   * \brief Generate prefetches for the targets of a value's GC pointers.
+   * \param ty The type of the value.
+   * \param addr The address of the value.
+   */
+  void prefetch(const GenType* ty, llvm::Value* addr);
+
+  /*!
+   * This prefetches the targets of the element prefetchDistance
+   * iterations ahead of the current one, or of the current element
+   * near the end of the array.
+   *
+   * \brief Generate prefetches for an array element further ahead.
+   * \param elemty The element type of the array.
+   * \param arr The address of the array.
+   * \param idx The current element index, as a 64-bit integer.
+   * \param len The length of the array, as a 64-bit integer.
+   */
+  void prefetchAhead(const GenType* elemty,
+                     llvm::Value* arr,
+                     llvm::Value* idx,
+                     llvm::Value* len);
+
+  /*!
+   * This compares a pointer against the bounds of the collected heap,
+   * as given in the GC context.  The heap start is never null, so
+   * null pointers are outside of it.  The visit functions for GC
+   * pointers leave any pointer outside of it alone, the same as the
+   * vectorized scan does.
+   *
+   * \brief Generate a check whether a pointer is in the collected heap.
+   * \param ptr The pointer.
+   * \param BB Basic block to which to append instructions.
+   * \return An i1 which is true if ptr is in the collected heap.
+   */
+  llvm::Value* inHeap(llvm::Value* ptr, llvm::BasicBlock* BB);
+
+  /*!
+   * Arrays of plain strong GC pointers are scanned in blocks of
+   * scanWidth slots, which are loaded as a vector and checked against
+   * the bounds of the collected heap all at once.  This holds for
+   * pointers which are not inlined, and only without double pointers.
+   *
+   * \brief Check whether an array's elements can be scanned in blocks.
+   * \param elemty The element type of the array.
+   * \return Whether to use scanPointers for the array.
+   */
+  bool vectorScan(const GenType* elemty);
+
+  /*!
+   * This generates a loop over blocks of scanWidth slots, which loads
+   * each block as a vector, hands it to filteredBlock, and skips it
+   * entirely if no slot points into the collected heap, as given by
+   * the heap bounds in the GC context.  Otherwise, only the slots
+   * which do are visited.  The leftover slots at the end of the range
+   * are visited one at a time, and left to the visit function to
+   * check.
+   *
+   * \brief Generate a vectorized scan over a range of GC pointers.
+   * \param ptrty The element type of the array.
+   * \param srcarr The address of the source array.
+   * \param dstarr The address of the destination array.
+   * \param start The first element, as a 64-bit integer.
+   * \param end One past the last element, as a 64-bit integer.
+   */
+  void scanPointers(const GCPtrGenType* ptrty,
+                    llvm::Value* srcarr,
+                    llvm::Value* dstarr,
+                    llvm::Value* start,
+                    llvm::Value* end);
+
+  /*!
+   * This is called on each block in scanPointers before any of its
+   * slots are visited.  Slots which are null or point outside the
+   * collected heap are never visited, so subclasses which need to do
+   * something with them should do it here.
+   *
+   * \brief Generate code for a block of GC pointer slots.
+   * \param vec The vector of pointers loaded from the block.
+   * \param dst The address of the destination block, as a pointer to
+   *            the vector type.
+   */
+  virtual void filteredBlock(llvm::Value* vec, llvm::Value* dst);
+
+  /*!
+   * This is called on each inlined object before its body is
+   * traversed.  Subclasses which produce a new object (such as copy
+   * code) have to fill in the inlined object's header here.
+   *
+   * \brief Generate code for the header of an inlined object.
+   * \param gcty The inlined GC pointer field.
+   * \param src Pointer to the source inlined object.
+   * \param dst Pointer to the destination inlined object.
+   */
+  virtual void inlinedHeader(const GCPtrGenType* gcty,
+                             llvm::Value* src,
+                             llvm::Value* dst);
+
+  /*!
+   * \brief Generate loops over the columns of a structure-of-arrays.
+   * \param gcty The array type.
+   * \param parent The context of the aggregate holding the array.
+   */
+  void columns(const ArrayGenType* gcty, struct IndexState& parent);
 public:
   /*!
-   * Initialize with a source value, destination value, context value,
-   * and basic block.
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  CopyGCTraceGen(llvm::Module& M,
+                 const GCParams& params,
+                 const FieldInliner* const inliner = NULL) :
+    M(M), params(params), gcctx(NULL), BB(NULL), srcobj(NULL),
+    inliner(inliner), clustered(NULL) {}
+
+  /*!
+   * An object is clusterable if following the last field of each
+   * structure down from the body leads to an array which is either
+   * unsized, or has at least GCParams::clusterSize elements.
+   * Structure-of-arrays arrays are never clustered.
    *
-   * \brief Initialize with source and destination pointers, context,
-   *        and basic block LLVM values.
-   * \param src The source pointer LLVM value.
-   * \param dst The destination pointer LLVM value.
-   * \param gccty The GC context LLVM value.
-   * \param BB The LLVM basic block.
+   * \brief Get the array of a type which is split into clusters.
+   * \param ty The type of the object.
+   * \return The clustered array, or null if there is none.
    */
-  CopyGCTraceGen(const llvm::Value* src,
-                 const llvm::Value* dst,
-                 const llvm::Value* gcctx,
-                 const llvm::BasicBlock* BB);
+  static const ArrayGenType* clusterArray(const GenType* ty);
+
+  /*!
+   * \brief Number of GC pointer slots checked at once by scanPointers.
+   */
+  static const unsigned scanWidth = 8;
 
   // These functions will implement generation of the "skeleton" of
   // getelementptr and loops that will traverse the type.
-  virtual const llvm::Value* initial(const GenType* ty);
-
   virtual bool begin(const StructGenType* ty, struct IndexState&,
 		     struct IndexState&);
   virtual bool begin(const FuncPtrGenType* ty, struct IndexState&,
@@ -112,6 +354,17 @@ public:
   virtual bool descend(const StructGenType* ty) = 0;
   virtual bool descend(const ArrayGenType* ty) = 0;
 
+  /*!
+   * Structure-of-arrays arrays are traversed one column at a time.
+   * Subclasses which only care about some fields (such as trace
+   * code, which only cares about GC pointers) can skip the others.
+   *
+   * \brief Decide whether to traverse a column.
+   * \param ty The element type of the column.
+   * \return Whether to generate a loop over the column.
+   */
+  virtual bool descendColumn(const GenType* ty);
+
   /*!
    * This function should generate copy code for a native pointer
    * field, given a source and destination value.  The source and
@@ -124,8 +377,8 @@ public:
    * \param dst An LLVM value with the destination address.
    */
   virtual void visit(const NativePtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst) = 0;
+		     llvm::Value* src,
+		     llvm::Value* dst) = 0;
 
   /*!
    * This function should generate copy code for a GC pointer field,
@@ -139,8 +392,8 @@ public:
    * \param dst An LLVM value with the destination address.
    */
   virtual void visit(const GCPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst) = 0;
+		     llvm::Value* src,
+		     llvm::Value* dst) = 0;
 
   /*!
    * This function should generate copy code for a function pointer
@@ -154,8 +407,8 @@ public:
    * \param dst An LLVM value with the destination address.
    */
   virtual void visit(const FuncPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst) = 0;
+		     llvm::Value* src,
+		     llvm::Value* dst) = 0;
   /*!
    * This function should generate copy code for a primitive type
    * field, given a source and destination value.  The source and
@@ -168,8 +421,8 @@ public:
    * \param dst An LLVM value with the destination address.
    */
   virtual void visit(const PrimGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst) = 0;
+		     llvm::Value* src,
+		     llvm::Value* dst) = 0;
 };
 
 /*!
@@ -183,50 +436,471 @@ public:
  * \brief A visitor which creates copy code.
  */
 class CopyCodeGen : public CopyGCTraceGen {
+private:
+  GCHeader header;
+  Runtime runtime;
+
+  /*!
+   * \brief The type descriptor table, or null if not set.
+   */
+  llvm::GlobalVariable* desctable;
+
+  /*!
+   * \brief The descriptor indexes of the named types, or null.
+   */
+  const llvm::StringMap<unsigned>* descidxs;
+
+  /*!
+   * \brief Generate code to copy a scalar field.
+   * \param src An LLVM value with the source address.
+   * \param dst An LLVM value with the destination address.
+   */
+  void copy(llvm::Value* src, llvm::Value* dst);
+
+  /*!
+   * This generates the fast path of a Cheney-style copy.  Null
+   * pointers are left alone, pointers to objects which have already
+   * been forwarded get the forwarding address, and anything else is
+   * handed to the runtime to be evacuated.  Pointers which aren't
+   * strong keep their old value if the referent hasn't been copied
+   * yet, and the field is passed to core.gc.weakref, so the runtime
+   * can fix it up once tracing is done.
+   *
+   * \brief Generate code to get the new address of a referenced object.
+   * \param gcty The type of the pointer.
+   * \param ptr The pointer value, as read from the source object.
+   * \param field The field in the destination object.
+   * \return The new pointer value, of the same type as ptr.
+   */
+  llvm::Value* evacuate(const GCPtrGenType* gcty,
+                        llvm::Value* ptr,
+                        llvm::Value* field);
+
+  /*!
+   * This generates the slow path of evacuation for parallel copying.
+   * It reserves a copy from the runtime, and tries to forward the
+   * object to it.  If another thread forwarded the object first, the
+   * copy is given back, and the other thread's copy is used.
+   *
+   * \brief Generate code to evacuate an object with atomic forwarding.
+   * \param raw The object, as an i8*.
+   * \param curBB The current basic block, which is updated.
+   * \return The new address of the object, as an i8*.
+   */
+  llvm::Value* parallelEvacuate(llvm::Value* raw, llvm::BasicBlock*& curBB);
+
+  /*!
+   * \brief Generate a memcpy of the whole of an aggregate.
+   * \param src Pointer to the source aggregate.
+   * \param dst Pointer to the destination aggregate.
+   */
+  void copyWhole(llvm::Value* src, llvm::Value* dst);
+
+  /*!
+   * \brief Generate a memcpy of a run of fields in a structure.
+   * \param ctx The context of the structure.
+   * \param first The first field in the run.
+   * \param last The last field in the run.
+   */
+  void copyRange(const struct IndexState& ctx,
+                 unsigned first,
+                 unsigned last);
+
 public:
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  CopyCodeGen(llvm::Module& M,
+              const GCParams& params,
+              const FieldInliner* const inliner = NULL) :
+    CopyGCTraceGen(M, params, inliner), header(M, params), runtime(M),
+    desctable(NULL), descidxs(NULL) {}
+
+  /*!
+   * The copy functions fill in the headers of inlined objects from
+   * the descriptors of their types, so this must be set before
+   * generating copy functions for types with inlined fields.
+   *
+   * \brief Set the type descriptor table.
+   * \param table The type descriptor table.
+   * \param idxs The descriptor index of each named type.
+   */
+  void setDescTable(llvm::GlobalVariable* table,
+                    const llvm::StringMap<unsigned>* idxs);
+
+  /*!
+   * \brief Get the type of copy functions.
+   * \return The type of copy functions.
+   */
+  llvm::FunctionType* getCopyFuncType();
+
+  /*!
+   * \brief Get the type of cluster-range copy functions.
+   * \return The type of cluster-range copy functions.
+   */
+  llvm::FunctionType* getClusterFuncType();
+
+  /*!
+   * This generates a copy function for the type named T, called
+   * T.copy.  It has the signature void (i8* ctx, i8* src, i8* dst),
+   * so that the runtime can call it through the type descriptor
+   * table.  It fills in the body of dst from src, evacuating the
+   * objects referenced by src.  The header and length word of dst
+   * are assumed to have been filled in by the runtime.  The headers
+   * of inlined objects in dst are written fresh, with the flags and
+   * age cleared.
+   *
+   * \brief Generate the copy function for a type.
+   * \param ty The type for which to generate a copy function.
+   * \param realty The realization of ty.
+   * \return The copy function.
+   */
+  llvm::Function* generate(const GenType* ty, llvm::StructType* realty);
+
+  /*!
+   * If clusterize is set in the GC params, and the type has a
+   * clustered array, this generates T.copy.cluster, with the
+   * signature void (i8* ctx, i8* src, i8* dst, i64 start, i64 end).
+   * It copies elements [start, end) of the clustered array, which
+   * T.copy leaves out.  Separate ranges may be copied by separate
+   * threads.
+   *
+   * \brief Generate the cluster-range copy function for a type.
+   * \param ty The type for which to generate a copy function.
+   * \param realty The realization of ty.
+   * \return The cluster-range copy function, or null.
+   */
+  llvm::Function* generateCluster(const GenType* ty,
+                                  llvm::StructType* realty);
+
+  /*!
+   * Rather than visiting each field, this copies each maximal run of
+   * fixed-size, pointer-free fields with a single memcpy, and only
+   * visits the fields in between.
+   */
+  virtual bool begin(const StructGenType* ty, struct IndexState&,
+		     struct IndexState&);
+
+  /*!
+   * Fixed-size, pointer-free arrays are copied with a single memcpy
+   * rather than a loop.
+   */
+  virtual bool begin(const ArrayGenType* ty, struct IndexState&,
+		     struct IndexState&);
+
+  /*!
+   * The slots of a scanned block which aren't visited are copied by
+   * storing the whole block to the destination.
+   */
+  virtual void filteredBlock(llvm::Value* vec, llvm::Value* dst);
+
+  /*!
+   * The inlined object in the destination gets a new header, rather
+   * than whatever the source's header held, and the inlined object
+   * in the source is forwarded to it.
+   */
+  virtual void inlinedHeader(const GCPtrGenType* gcty,
+                             llvm::Value* src,
+                             llvm::Value* dst);
+
   virtual bool descend(const StructGenType* ty);
   virtual bool descend(const ArrayGenType* ty);
   virtual void visit(const NativePtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const GCPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const PrimGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const FuncPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
 };
 
 /*!
- * This is a subclass of GenTypeVisitor which creates GC syncronization
- * code for a given GC type.  This is designed to fill in the body of
- * a function with instructions that propagate changes from the source
- * heap to the destination.
+ * This is a subclass of GenTypeVisitor which creates GC trace code for
+ * a given GC type.  This is designed to fill in the body of a function
+ * which calls the mark function on every GC pointer in an object.
  *
- * This is used in the implementation of concurrent and semispace
+ * Aggregates and structure-of-arrays columns which contain no GC
+ * pointers are skipped entirely, so arrays of primitives get no loop.
+ * Types with no GC pointers at all share a single empty trace
+ * function, core.gc.notrace, which the collector can recognize and
+ * skip.
+ *
+ * This is used in the implementation of mark-sweep and generational
  * garbage collection.
  *
- * \brief A visitor which creates copy code.
+ * \brief A visitor which creates trace code.
  */
-class SyncCodeGen  : public CopyGCTraceGen {
+class TraceCodeGen : public CopyGCTraceGen {
+private:
+  Runtime runtime;
+
 public:
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  TraceCodeGen(llvm::Module& M,
+               const GCParams& params,
+               const FieldInliner* const inliner = NULL) :
+    CopyGCTraceGen(M, params, inliner), runtime(M) {}
+
+  /*!
+   * \brief Get the type of trace functions.
+   * \return The type of trace functions.
+   */
+  llvm::FunctionType* getTraceFuncType();
+
+  /*!
+   * \brief Get the type of cluster-range trace functions.
+   * \return The type of cluster-range trace functions.
+   */
+  llvm::FunctionType* getClusterFuncType();
+
+  /*!
+   * This function gets the shared empty trace function, creating it
+   * in the module as core.gc.notrace if it does not already exist.
+   *
+   * \brief Get the trace function for types with no GC pointers.
+   * \return The empty trace function.
+   */
+  llvm::Function* getNoTrace();
+
+  /*!
+   * This generates a trace function for the type named T, called
+   * T.trace.  It has the signature void (i8* ctx, i8* obj).  If T
+   * contains no GC pointers, no function is generated, and the shared
+   * empty trace function is returned instead.
+   *
+   * \brief Generate the trace function for a type.
+   * \param ty The type for which to generate a trace function.
+   * \param realty The realization of ty.
+   * \return The trace function.
+   */
+  llvm::Function* generate(const GenType* ty, llvm::StructType* realty);
+
+  /*!
+   * If clusterize is set in the GC params, and the type has a
+   * clustered array containing GC pointers, this generates
+   * T.trace.cluster, with the signature
+   * void (i8* ctx, i8* obj, i64 start, i64 end).  It traces elements
+   * [start, end) of the clustered array, which T.trace leaves out.
+   * Separate ranges may be traced by separate threads.
+   *
+   * \brief Generate the cluster-range trace function for a type.
+   * \param ty The type for which to generate a trace function.
+   * \param realty The realization of ty.
+   * \return The cluster-range trace function, or null.
+   */
+  llvm::Function* generateCluster(const GenType* ty,
+                                  llvm::StructType* realty);
+
   virtual bool descend(const StructGenType* ty);
   virtual bool descend(const ArrayGenType* ty);
+  virtual bool descendColumn(const GenType* ty);
   virtual void visit(const NativePtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const GCPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const PrimGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
   virtual void visit(const FuncPtrGenType* gcty,
-		     const llvm::Value* src,
-		     const llvm::Value* dst);
+		     llvm::Value* src,
+		     llvm::Value* dst);
+};
+
+/*!
+ * This is a subclass of GenTypeVisitor which creates GC move code for
+ * a given GC type.  This is designed to fill in the body of a
+ * function which slides an object to its new address, and updates
+ * the GC pointers in it to point to the new addresses of their
+ * referents.
+ *
+ * Aggregates and structure-of-arrays columns which contain no GC
+ * pointers are skipped, as the object is moved in one piece.
+ *
+ * This is used in the implementation of sliding compacting garbage
+ * collection.
+ *
+ * \brief A visitor which creates move code.
+ */
+class MoveCodeGen : public CopyGCTraceGen {
+private:
+  Runtime runtime;
+
+public:
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  MoveCodeGen(llvm::Module& M,
+              const GCParams& params,
+              const FieldInliner* const inliner = NULL) :
+    CopyGCTraceGen(M, params, inliner), runtime(M) {}
+
+  /*!
+   * \brief Get the type of move functions.
+   * \return The type of move functions.
+   */
+  llvm::FunctionType* getMoveFuncType();
+
+  /*!
+   * This generates a move function for the type named T, called
+   * T.move.  It has the signature void (i8* ctx, i8* src, i8* dst).
+   * It moves the whole object, header and length word included, from
+   * src to dst, which may overlap (as when sliding objects down), and
+   * then updates each GC pointer in the moved object through
+   * core.gc.relocate.
+   *
+   * \brief Generate the move function for a type.
+   * \param ty The type for which to generate a move function.
+   * \param realty The realization of ty.
+   * \return The move function.
+   */
+  llvm::Function* generate(const GenType* ty, llvm::StructType* realty);
+
+  virtual bool descend(const StructGenType* ty);
+  virtual bool descend(const ArrayGenType* ty);
+  virtual bool descendColumn(const GenType* ty);
+  virtual void visit(const NativePtrGenType* gcty,
+		     llvm::Value* src,
+		     llvm::Value* dst);
+  virtual void visit(const GCPtrGenType* gcty,
+		     llvm::Value* src,
+		     llvm::Value* dst);
+  virtual void visit(const PrimGenType* gcty,
+		     llvm::Value* src,
+		     llvm::Value* dst);
+  virtual void visit(const FuncPtrGenType* gcty,
+		     llvm::Value* src,
+		     llvm::Value* dst);
+};
+
+/*!
+ * This is a subclass of GenTypeVisitor which creates GC syncronization
+ * code for a given GC type.  This is designed to fill in the body of
+ * a function with instructions that propagate changes from the source
+ * heap to the destination.
+ *
+ * Writes are recorded in the write log as core.gc.logentry
+ * structures (see Context), which name the written field by its leaf
+ * and element numbers (see LeafEnumerator).  Each logged field is
+ * copied the same way as in a copy function, so GC pointers get
+ * translated through forwarding.
+ *
+ * This is used in the implementation of concurrent and semispace
+ * garbage collection.
+ *
+ * \brief A visitor which creates sync code.
+ */
+class SyncCodeGen : public CopyCodeGen {
+private:
+  Context context;
+  LeafEnumerator leaves;
+
+  /*!
+   * \brief Add a switch case which syncs a single leaf.
+   * \param leaf The leaf.
+   * \param src Pointer to the source object.
+   * \param dst Pointer to the destination object.
+   * \param elem The logged element number.
+   * \param sw The switch on the logged leaf number.
+   * \param num The number of this leaf.
+   */
+  void leafCase(const Leaf& leaf,
+                llvm::Value* src,
+                llvm::Value* dst,
+                llvm::Value* elem,
+                llvm::SwitchInst* sw,
+                unsigned num);
+
+  /*!
+   * This generates core.gc.logentry.cmp, with the signature
+   * i32 (core.gc.logentry* a, core.gc.logentry* b).  It orders log
+   * entries by object address, then leaf, then element, returning a
+   * negative, zero, or positive result like a qsort comparator.
+   *
+   * \brief Generate the log entry comparison function.
+   * \return The comparison function.
+   */
+  llvm::Function* generateCompare();
+
+  /*!
+   * This generates core.gc.logentry.siftdown, with the signature
+   * void (core.gc.logentry* log, i64 root, i64 end).  It restores
+   * the max-heap property of the first end entries, when only the
+   * entry at root may be smaller than its children.
+   *
+   * \brief Generate the heapsort sift-down function.
+   * \param cmp The log entry comparison function.
+   * \return The sift-down function.
+   */
+  llvm::Function* generateSiftDown(llvm::Function* cmp);
+
+public:
+  /*!
+   * \brief Initialize with the LLVM Module and GC params.
+   * \param M The LLVM Module.
+   * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
+   */
+  SyncCodeGen(llvm::Module& M,
+              const GCParams& params,
+              const FieldInliner* const inliner = NULL) :
+    CopyCodeGen(M, params, inliner), context(M, params), leaves(inliner) {}
+
+  /*!
+   * \brief Get the type of sync functions.
+   * \return The type of sync functions.
+   */
+  llvm::FunctionType* getSyncFuncType();
+
+  /*!
+   * This generates a sync function for the type named T, called
+   * T.sync.  It has the signature
+   * void (i8* ctx, i8* src, i8* dst, core.gc.logentry* log, i64 n),
+   * and copies the fields named by the n log entries from src to dst.
+   * The object pointers in the entries are not looked at; the caller
+   * is expected to have grouped the entries by object.  The cost is
+   * proportional to the number of entries, not the size of the
+   * object.
+   *
+   * \brief Generate the sync function for a type.
+   * \param ty The type for which to generate a sync function.
+   * \param realty The realization of ty.
+   * \return The sync function.
+   */
+  llvm::Function* generate(const GenType* ty, llvm::StructType* realty);
+
+  /*!
+   * This generates core.gc.compactlog, with the signature
+   * i64 (core.gc.logentry* log, i64 n).  It sorts the n entries by
+   * object, then leaf, then element, drops the duplicates, and
+   * returns the number of entries left.  The sort is an in-place
+   * heapsort, so this needs no memory and calls nothing outside the
+   * module.  Afterward, the entries for
+   * each object are together, so that each object's sync function
+   * can be called once, on its run of entries, and the work done by
+   * sync depends only on the number of distinct writes.
+   *
+   * \brief Generate the write log compaction function.
+   * \return The compaction function.
+   */
+  llvm::Function* generateCompact();
 };
 
 #endif
@@ -21,6 +21,8 @@
 #include "GenType.h"
 #include "GenTypeVisitors.h"
 #include "GCParams.h"
+#include "GCHeader.h"
+#include "FieldInliner.h"
 #include "TypeBuilder.h"
 #include "llvm/IR/Module.h"
 
@@ -35,14 +37,36 @@ class TypeRealizer : public GenTypeCtxVisitor<TypeBuilder*> {
 private:
   llvm::Module& M;
   const GCParams& params;
+  GCHeader header;
+  const FieldInliner* const inliner;
 public:
   /*!
    * \brief Initialize with GC params and the LLVM Module.
    * \param M The LLVM Module.
    * \param params The GC parameters.
+   * \param inliner The object inlining policy, or null for none.
    */
-  TypeRealizer(llvm::Module& M, const GCParams& params) :
-    M(M), params(params) {}
+  TypeRealizer(llvm::Module& M, const GCParams& params,
+               const FieldInliner* const inliner = NULL) :
+    M(M), params(params), header(M, params), inliner(inliner) {}
+
+  /*!
+   * This is always the field immediately following the header.  It
+   * is only present in variable-sized objects.
+   *
+   * \brief Get the index of the length word in a realized object.
+   * \return The index of the length word.
+   */
+  static inline unsigned lengthIndex() { return 1; }
+
+  /*!
+   * \brief Get the index of the body in a realized object.
+   * \param ty The type that was realized.
+   * \return The index of the body in the realization of ty.
+   */
+  static inline unsigned bodyIndex(const GenType* const ty) {
+    return ty->isVariableSized() ? 2 : 1;
+  }
 
   virtual bool begin(const StructGenType*, TypeBuilder*&, TypeBuilder*&);
   virtual bool begin(const FuncPtrGenType*, TypeBuilder*&, TypeBuilder*&);
@@ -58,7 +82,14 @@ public:
 
   /*!
    * This function realizes a GC type as an LLVM type by having the
-   * visitor visit the type.
+   * visitor visit the type.  The result is a named structure whose
+   * first field is the object header, and whose last field is the
+   * realization of the type itself.  If the type is variable-sized,
+   * then a 64-bit length word sits between the two, and the unsized
+   * array is realized as a zero-length array at the end of the
+   * object.  Arrays with the structure-of-arrays layout are realized
+   * as a structure with one array (or column) for each field of the
+   * element type.
    *
    * \brief Convert a GC type into an LLVM type.
    * \param ty Type to convert.
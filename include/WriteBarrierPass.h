@@ -0,0 +1,349 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+#ifndef _WRITE_BARRIER_PASS_H_
+#define _WRITE_BARRIER_PASS_H_
+
+#include <set>
+#include <vector>
+#include "GenType.h"
+#include "GCParams.h"
+#include "Context.h"
+#include "Runtime.h"
+#include "LeafEnumerator.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+/*!
+ * \brief A field whose writes may be logged, as seen by its modifier.
+ */
+struct LoggedField {
+  /*!
+   * \brief The leaf number of the field.
+   */
+  unsigned leaf;
+
+  /*!
+   * \brief The effective mutability of the field.
+   */
+  GenType::Mutability mutability;
+
+  /*!
+   * \brief Whether the field is a GC pointer.
+   */
+  bool gcptr;
+
+  /*!
+   * The modifier takes one index argument per array, outermost
+   * first, right after the object.
+   *
+   * \brief Lengths of the arrays enclosing the field, outermost first.
+   */
+  llvm::SmallVector<unsigned, 4> dims;
+
+  /*!
+   * \brief The path to the field, as given by LeafEnumerator.
+   */
+  llvm::SmallVector<LeafStep, 8> path;
+
+  /*!
+   * \brief The realization of the type owning the field, or null.
+   */
+  llvm::StructType* realty;
+};
+
+/*!
+ * \brief What is known about a program point, for barrier elision.
+ */
+struct BarrierFacts {
+  /*!
+   * Each write is identified by the modifier, the object, and the
+   * index arguments.
+   *
+   * \brief Writes logged since the last safepoint, on every path.
+   */
+  std::set<std::vector<const llvm::Value*> > logged;
+
+  /*!
+   * \brief Objects allocated since the last safepoint which have not
+   *        escaped, on every path.
+   */
+  std::set<const llvm::Value*> fresh;
+};
+
+/*!
+ * This pass inserts write barriers for write logging and card
+ * marking.  If writeLogging is set, every call to a modifier function
+ * declared in the GC type metadata is followed by an append of
+ * { obj, leaf, elem } to the write log, with leaves and elements
+ * numbered as by LeafEnumerator, so that the sync functions can
+ * replay the entry.  If cardMarking is set, every call to a GC
+ * pointer modifier is followed by an unconditional store marking the
+ * card holding the start of the object as dirty.  If satbBarriers is
+ * set, every call to a GC pointer modifier is preceded by a check of
+ * the context's marking flag, and if marking is active, the old value
+ * of the field, unless it is null, is added to the mark queue.  The
+ * mark queue is a buffer like the write log, with core.gc.markfull
+ * as its slow path.
+ *
+ * The append is inlined.  The fast path loads the current thread's
+ * context, checks the log cursor against the end of the buffer,
+ * stores the entry, and bumps the cursor.  Only when the buffer is
+ * full does it call out to core.gc.logfull, and then try again.
+ *
+ * The modifier calls themselves are left alone; they are always
+ * inlined, so the store and the barrier end up next to each other.
+ * This has to run before the inliner, though, or there will be no
+ * calls left to find.
+ *
+ * Writes which are already logged (or marked) are not logged again.
+ * Sync copies the value the field has at the time of the sync, so
+ * one entry for an (object, field, element) is as good as many, as
+ * long as no safepoint comes in between (after which the log may
+ * have been drained, or the card cleaned).  A forward dataflow over
+ * each function finds the modifier calls for which an identical
+ * call, with the same object and index values, has been made on
+ * every path since the last call that may reach a safepoint.
+ *
+ * Writes to fresh objects, which were allocated since the last
+ * safepoint and have not escaped since, aren't logged, whatever the
+ * field, as the collector can't have copied them yet.  Immutable
+ * fields get no special treatment: their initializing writes may
+ * come after a safepoint, once the object may have been copied.  An
+ * object escapes when it is stored, passed to anything other than an
+ * accessor or modifier, or otherwise used for more than its address.
+ * The same elisions apply to SATB barriers; anything overwritten in
+ * a fresh object, or overwritten a second time, was written after
+ * marking started.  Card marks are only skipped for writes already
+ * marked since the last safepoint.  A fresh object may have been
+ * allocated straight into the old generation, so a GC pointer stored
+ * into it still needs its card marked.
+ *
+ * This does nothing unless writeLogging, cardMarking, or satbBarriers
+ * is set in the GC params.
+ *
+ * \brief A pass to insert write barriers.
+ */
+struct WriteBarrierPass : public llvm::ModulePass {
+private:
+  const GCParams& params;
+  llvm::DenseMap<const llvm::Function*, LoggedField> fields;
+  llvm::SmallPtrSet<const llvm::Function*, 32> accessors;
+  llvm::SmallPtrSet<const llvm::Function*, 32> allocators;
+
+  /*!
+   * A modifier shared by several types must write the same field in
+   * each of them; otherwise this reports an error and aborts.
+   *
+   * \brief Find the field for every modifier, and the allocators.
+   * \param M The LLVM Module.
+   * \param types The named GC types.
+   */
+  void findFields(llvm::Module& M,
+                  const llvm::StringMap<const GenType*>& types);
+
+  /*!
+   * Calls to accessors and modifiers, and to intrinsics other than
+   * statepoints, are the only calls known not to reach a safepoint.
+   *
+   * \brief Check whether an instruction may reach a safepoint.
+   * \param I The instruction.
+   * \return Whether I may reach a safepoint.
+   */
+  bool maySafepoint(const llvm::Instruction* I) const;
+
+  /*!
+   * \brief Check whether a use of an object lets it escape.
+   * \param I The user.
+   * \param idx The operand index of the use in I.
+   * \return Whether the use lets the object escape.
+   */
+  bool escapes(const llvm::Instruction* I, unsigned idx) const;
+
+  /*!
+   * \brief Check whether a write needs no log entry or SATB barrier.
+   * \param call The call to the modifier.
+   * \param facts What is known just before the call.
+   * \return Whether the write can go without a log entry or SATB
+   *         barrier.
+   */
+  bool unneeded(const llvm::CallInst* call, const BarrierFacts& facts)
+    const;
+
+  /*!
+   * \brief Apply a block to the barrier facts.
+   * \param BB The basic block.
+   * \param facts The facts on entry to BB, updated to those on exit.
+   * \param elided The set to which to add calls needing no barrier,
+   *        or null.
+   * \param unlogged The set to which to add calls needing only a
+   *        card mark, or null.
+   */
+  void transfer(const llvm::BasicBlock* BB,
+                BarrierFacts& facts,
+                llvm::SmallPtrSetImpl<const llvm::CallInst*>* elided,
+                llvm::SmallPtrSetImpl<const llvm::CallInst*>* unlogged)
+    const;
+
+  /*!
+   * \brief Find the modifier calls that need no barrier, or only a
+   *        card mark.
+   * \param F The function to search.
+   * \param elided The set to which to add calls needing no barrier.
+   * \param unlogged The set to which to add calls needing only a
+   *        card mark.
+   */
+  void findElided(llvm::Function& F,
+                  llvm::SmallPtrSetImpl<const llvm::CallInst*>& elided,
+                  llvm::SmallPtrSetImpl<const llvm::CallInst*>& unlogged)
+    const;
+
+  /*!
+   * \brief Generate code to compute the element number of a write.
+   * \param call The call to the modifier.
+   * \param field The field being written.
+   * \param BB Basic block to which to append instructions.
+   * \return The element number, as a 64-bit integer.
+   */
+  llvm::Value* elemNumber(llvm::CallInst* call,
+                          const LoggedField& field,
+                          llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Generate code to mark the card holding an object.
+   * \param context The GC execution context layout.
+   * \param ctx Pointer to the current context.
+   * \param obj The object, as an i8*.
+   * \param BB Basic block to which to append instructions.
+   */
+  void markCard(Context& context,
+                llvm::Value* ctx,
+                llvm::Value* obj,
+                llvm::BasicBlock* BB);
+
+  /*!
+   * This generates the check of the buffer, calling the overflow
+   * function until there is room, and then bumps the cursor.  Since
+   * this needs control flow, the current block is updated to the
+   * block after the check.
+   *
+   * \brief Generate code to get a slot in a buffer in the context.
+   * \param context The GC execution context layout.
+   * \param ctx Pointer to the current context.
+   * \param curidx Index of the buffer's cursor in the context.
+   * \param endidx Index of the buffer's end in the context.
+   * \param overflow The function to call when the buffer is full.
+   * \param BB The current basic block, which is updated.
+   * \return A pointer to the slot.
+   */
+  llvm::Value* bufferSlot(Context& context,
+                          llvm::Value* ctx,
+                          unsigned curidx,
+                          unsigned endidx,
+                          llvm::Function* overflow,
+                          llvm::BasicBlock*& BB);
+
+  /*!
+   * \brief Generate code to append a write to the write log.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param ctx Pointer to the current context.
+   * \param obj The object, as an i8*.
+   * \param call The call to the modifier.
+   * \param field The field being written.
+   * \param BB Basic block to which to append instructions.
+   * \param restBB Basic block to branch to afterward.
+   */
+  void appendLog(Context& context,
+                 Runtime& runtime,
+                 llvm::Value* ctx,
+                 llvm::Value* obj,
+                 llvm::CallInst* call,
+                 const LoggedField& field,
+                 llvm::BasicBlock* BB,
+                 llvm::BasicBlock* restBB);
+
+  /*!
+   * \brief Generate code to load the value a modifier will overwrite.
+   * \param context The GC execution context layout.
+   * \param ctx Pointer to the current context.
+   * \param call The call to the modifier.
+   * \param field The field being written.
+   * \param BB Basic block to which to append instructions.
+   * \return The old value of the field.
+   */
+  llvm::Value* oldValue(Context& context,
+                        llvm::Value* ctx,
+                        llvm::CallInst* call,
+                        const LoggedField& field,
+                        llvm::BasicBlock* BB);
+
+  /*!
+   * \brief Insert an SATB barrier before a call to a modifier.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param call The call to the modifier.
+   * \param field The field being written.
+   */
+  void insertSATB(Context& context,
+                  Runtime& runtime,
+                  llvm::CallInst* call,
+                  const LoggedField& field);
+
+  /*!
+   * \brief Insert write barriers after a call to a modifier.
+   * \param context The GC execution context layout.
+   * \param runtime The runtime function declarations.
+   * \param call The call to the modifier.
+   * \param field The field being written.
+   * \param log Whether to append to the write log.
+   */
+  void insertBarrier(Context& context,
+                     Runtime& runtime,
+                     llvm::CallInst* call,
+                     const LoggedField& field,
+                     bool log);
+
+public:
+  static char ID;
+
+  /*!
+   * \brief Initialize with the GC params.
+   * \param params The GC parameters.
+   */
+  WriteBarrierPass(const GCParams& params) :
+    llvm::ModulePass(ID), params(params) {}
+
+  /*!
+   * \brief Initialize with the GC params given on the command line.
+   */
+  WriteBarrierPass() :
+    llvm::ModulePass(ID), params(GCParams::fromFlags()) {}
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage& AU) const;
+
+  virtual bool runOnModule(llvm::Module& M);
+};
+
+#endif
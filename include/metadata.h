@@ -41,6 +41,16 @@ enum {
   PTR_MOB_IMMOBILE = 1
 };
 
+enum {
+  PTR_OWN_SHARED = 0,
+  PTR_OWN_UNIQUE = 1
+};
+
+enum {
+  ARRAY_LAYOUT_AOS = 0,
+  ARRAY_LAYOUT_SOA = 1
+};
+
 enum {
   PTRCLASS_STRONG = 0,
   PTRCLASS_SOFT = 1,
@@ -0,0 +1,349 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "AccessorGenerator.h"
+#include "TypeRealizer.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+
+// Walk up the chain of contexts to get the path to the field, then
+// turn it into indexes, innermost last.  Array levels take their
+// index from the function arguments, outermost first.  In a
+// structure-of-arrays array, the field picks the column before the
+// argument picks the element, so those two get swapped.
+llvm::Value* AccessorGenerator::fieldAddr(llvm::Function* const F,
+                                          const struct AccessState& parent,
+                                          const unsigned pos,
+                                          llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::SmallVector<int, 8> path;
+  llvm::SmallVector<llvm::Value*, 8> idxs;
+  llvm::Function::arg_iterator args = F->arg_begin();
+  llvm::Value* const obj =
+    llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                      "", BB);
+
+  path.push_back(parent.array ? -1 : (int)pos);
+
+  for(const struct AccessState* s = &parent; NULL != s->up; s = s->up)
+    if(s->up->soa) {
+      path.push_back(path.back());
+      path[path.size() - 2] = -1;
+    }
+    else
+      path.push_back(s->up->array ? -1 : (int)s->pos);
+
+  idxs.push_back(llvm::ConstantInt::get(int32ty, 0, false));
+
+  for(unsigned i = path.size(); i > 0; i--)
+    if(-1 == path[i - 1])
+      idxs.push_back(&*args++);
+    else
+      idxs.push_back(llvm::ConstantInt::get(int32ty, path[i - 1], false));
+
+  return llvm::GetElementPtrInst::CreateInBounds(obj, idxs, "", BB);
+}
+
+// Field nodes are named after the path from the object, so
+// different fields get different nodes.  MDNodes are uniqued, so
+// asking again for the same field gets the same node.
+llvm::MDNode* AccessorGenerator::fieldNode(const struct AccessState& parent,
+                                           const unsigned pos) {
+  llvm::MDBuilder builder(M.getContext());
+  const llvm::MDString* const parentname =
+    llvm::cast<llvm::MDString>(parent.tbaa->getOperand(0));
+  const std::string name =
+    (llvm::Twine(parentname->getString()) + "." + llvm::Twine(pos)).str();
+
+  return builder.createTBAAScalarTypeNode(name, parent.tbaa);
+}
+
+void AccessorGenerator::annotate(llvm::Instruction* const inst,
+                                 const struct AccessState& parent,
+                                 const unsigned pos) {
+  llvm::MDBuilder builder(M.getContext());
+  llvm::MDNode* const node = fieldNode(parent, pos);
+
+  inst->setMetadata(llvm::LLVMContext::MD_tbaa,
+                    builder.createTBAAStructTagNode(node, node, 0));
+}
+
+void AccessorGenerator::genAccess(llvm::Function* const F,
+                                  const struct AccessState& parent,
+                                  const unsigned pos) {
+  if(NULL != F && F->empty()) {
+    llvm::LLVMContext& C = M.getContext();
+    llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+    llvm::Value* const addr = fieldAddr(F, parent, pos, BB);
+    llvm::LoadInst* const val = new llvm::LoadInst(addr, "", BB);
+
+    annotate(val, parent, pos);
+
+    llvm::ReturnInst::Create(C, val, BB);
+    F->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
+}
+
+void AccessorGenerator::genModify(llvm::Function* const F,
+                                  const struct AccessState& parent,
+                                  const unsigned pos) {
+  if(NULL != F && F->empty()) {
+    llvm::LLVMContext& C = M.getContext();
+    llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+    llvm::Value* const addr = fieldAddr(F, parent, pos, BB);
+    llvm::Value* val = NULL;
+
+    // The new value is the last argument.
+    for(llvm::Function::arg_iterator i = F->arg_begin();
+        i != F->arg_end(); i++)
+      val = &*i;
+
+    annotate(new llvm::StoreInst(val, addr, BB), parent, pos);
+    llvm::ReturnInst::Create(C, BB);
+    F->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
+}
+
+// Objects are forwarded rarely enough that the branch should predict
+// well.
+llvm::Value* AccessorGenerator::readBarrier(llvm::Value* const val,
+                                            llvm::BasicBlock*& BB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::PointerType* const ptrty =
+    llvm::cast<llvm::PointerType>(val->getType());
+  llvm::BasicBlock* const checkBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const slowBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const endBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Value* const isnull =
+    new llvm::ICmpInst(*BB, llvm::ICmpInst::ICMP_EQ, val,
+                       llvm::ConstantPointerNull::get(ptrty), "");
+
+  llvm::BranchInst::Create(endBB, checkBB, isnull, BB);
+
+  llvm::Value* const fwd = header.isForwarded(val, checkBB);
+  llvm::BranchInst* const br =
+    llvm::BranchInst::Create(slowBB, endBB, fwd, checkBB);
+
+  br->setMetadata(llvm::LLVMContext::MD_prof,
+                  llvm::MDBuilder(C).createBranchWeights(1, 1000));
+
+  llvm::Value* const ctx =
+    new llvm::LoadInst(context.getCurrent(), "", slowBB);
+  llvm::Value* const args[2] = {
+    llvm::CastInst::CreatePointerCast(ctx, int8ptrty, "", slowBB),
+    llvm::CastInst::CreatePointerCast(val, int8ptrty, "", slowBB)
+  };
+  llvm::Value* const raw =
+    llvm::CallInst::Create(runtime.getReadBarrier(), args, "", slowBB);
+  llvm::Value* const resolved =
+    llvm::CastInst::CreatePointerCast(raw, ptrty, "", slowBB);
+
+  llvm::BranchInst::Create(endBB, slowBB);
+
+  llvm::PHINode* const phi = llvm::PHINode::Create(ptrty, 3, "", endBB);
+
+  phi->addIncoming(val, BB);
+  phi->addIncoming(val, checkBB);
+  phi->addIncoming(resolved, slowBB);
+  BB = endBB;
+
+  return phi;
+}
+
+// With double pointers, both slots get written, but only the one for
+// the current heap gets read.
+void AccessorGenerator::genGCPtrAccess(const GCPtrGenType* const gcty,
+                                       const struct AccessState& parent,
+                                       const unsigned pos) {
+  llvm::Function* const F = gcty->getAccessFunc();
+
+  if(NULL != F && F->empty()) {
+    llvm::LLVMContext& C = M.getContext();
+    llvm::BasicBlock* BB = llvm::BasicBlock::Create(C, "", F);
+    llvm::Value* addr = fieldAddr(F, parent, pos, BB);
+    llvm::Value* val;
+
+    if(NULL != inliner && NULL != inliner->getInlined(gcty))
+      val = llvm::CastInst::CreatePointerCast(addr, F->getReturnType(),
+                                              "", BB);
+    else {
+      if(params.doublePtrs) {
+        llvm::Value* const ctx =
+          new llvm::LoadInst(context.getCurrent(), "", BB);
+
+        addr = context.heapSlotAddr(ctx, addr, BB);
+      }
+
+      llvm::LoadInst* const load = new llvm::LoadInst(addr, "", BB);
+
+      annotate(load, parent, pos);
+      val = params.readBarriers ? readBarrier(load, BB) : load;
+    }
+
+    llvm::ReturnInst::Create(C, val, BB);
+    F->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
+}
+
+void AccessorGenerator::genGCPtrModify(const GCPtrGenType* const gcty,
+                                       const struct AccessState& parent,
+                                       const unsigned pos) {
+  if(!params.doublePtrs)
+    genModify(gcty->getModifyFunc(), parent, pos);
+  else {
+    llvm::Function* const F = gcty->getModifyFunc();
+
+    if(NULL != F && F->empty()) {
+      llvm::LLVMContext& C = M.getContext();
+      llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+      llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+      llvm::Value* const addr = fieldAddr(F, parent, pos, BB);
+      llvm::Value* val = NULL;
+
+      for(llvm::Function::arg_iterator i = F->arg_begin();
+          i != F->arg_end(); i++)
+        val = &*i;
+
+      for(unsigned i = 0; i < 2; i++) {
+        llvm::Value* idxs[2] = {
+          llvm::ConstantInt::get(int32ty, 0, false),
+          llvm::ConstantInt::get(int32ty, i, false)
+        };
+        llvm::Value* const slot =
+          llvm::GetElementPtrInst::CreateInBounds(addr, idxs, "", BB);
+
+        annotate(new llvm::StoreInst(val, slot, BB), parent, pos);
+      }
+
+      llvm::ReturnInst::Create(C, BB);
+      F->addFnAttr(llvm::Attribute::AlwaysInline);
+    }
+  }
+}
+
+void AccessorGenerator::genLength(const struct AccessState& root) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const argtys[1] = { realty->getPointerTo() };
+  llvm::FunctionType* const functy =
+    llvm::FunctionType::get(int64ty, argtys, false);
+  const std::string name = realty->getName().str() + ".length";
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::ExternalLinkage,
+                           name, &M);
+  llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Value* idxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    llvm::ConstantInt::get(int32ty, TypeRealizer::lengthIndex(), false)
+  };
+  llvm::Value* const addr =
+    llvm::GetElementPtrInst::CreateInBounds(&*F->arg_begin(), idxs, "", BB);
+  llvm::LoadInst* const len = new llvm::LoadInst(addr, "", BB);
+
+  annotate(len, root, TypeRealizer::lengthIndex());
+  llvm::ReturnInst::Create(C, len, BB);
+  F->addFnAttr(llvm::Attribute::AlwaysInline);
+}
+
+bool AccessorGenerator::begin(const StructGenType* const gcty,
+                              struct AccessState& ctx,
+                              struct AccessState& parent) {
+  ctx.up = &parent;
+  ctx.pos = nextPos(parent);
+  ctx.next = 0;
+  ctx.array = false;
+  ctx.soa = false;
+  ctx.tbaa = fieldNode(parent, ctx.pos);
+
+  return true;
+}
+
+// Function pointers have no accessors, but they still take up a
+// field.
+bool AccessorGenerator::begin(const FuncPtrGenType*,
+                              struct AccessState&,
+                              struct AccessState& parent) {
+  nextPos(parent);
+
+  return false;
+}
+
+bool AccessorGenerator::begin(const ArrayGenType* const gcty,
+                              struct AccessState& ctx,
+                              struct AccessState& parent) {
+  ctx.up = &parent;
+  ctx.pos = nextPos(parent);
+  ctx.next = 0;
+  ctx.array = true;
+  ctx.soa = ArrayGenType::SoA == gcty->getLayout();
+  ctx.tbaa = fieldNode(parent, ctx.pos);
+
+  return true;
+}
+
+void AccessorGenerator::visit(const NativePtrGenType*,
+                              struct AccessState& parent) {
+  nextPos(parent);
+}
+
+void AccessorGenerator::visit(const GCPtrGenType* const gcty,
+                              struct AccessState& parent) {
+  const unsigned pos = nextPos(parent);
+
+  genGCPtrAccess(gcty, parent, pos);
+  genGCPtrModify(gcty, parent, pos);
+}
+
+void AccessorGenerator::visit(const PrimGenType* const gcty,
+                              struct AccessState& parent) {
+  const unsigned pos = nextPos(parent);
+
+  genAccess(gcty->getAccessFunc(), parent, pos);
+  genModify(gcty->getModifyFunc(), parent, pos);
+}
+
+void AccessorGenerator::generate(const GenType* const ty,
+                                 llvm::StructType* const realty) {
+  // The top-level context stands for the object itself, so that
+  // the body ends up at the right index.
+  llvm::MDBuilder builder(M.getContext());
+  struct AccessState root;
+
+  root.up = NULL;
+  root.pos = 0;
+  root.next = TypeRealizer::bodyIndex(ty);
+  root.array = false;
+  root.soa = false;
+  root.tbaa =
+    builder.createTBAAScalarTypeNode(realty->getName(),
+                                     builder.createTBAARoot("core.gc.tbaa"));
+  this->realty = realty;
+  ty->accept(*this, root);
+
+  if(ty->isVariableSized())
+    genLength(root);
+}
@@ -0,0 +1,140 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "AllocGenerator.h"
+#include "TypeRealizer.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+
+// For variable-sized objects, the size is the offset of the trailing
+// array, plus the size of its elements, rounded up to the alignment
+// of the object, so that whatever gets allocated after it is aligned
+// too.
+llvm::Value* AllocGenerator::objSize(const GenType* const ty,
+                                     llvm::StructType* const realty,
+                                     llvm::Value* const len,
+                                     llvm::BasicBlock* const BB) {
+  const llvm::DataLayout& DL = BB->getParent()->getParent()->getDataLayout();
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(BB->getContext());
+
+  if(NULL == len)
+    return llvm::ConstantInt::get(int64ty, DL.getTypeAllocSize(realty),
+                                  false);
+  else {
+    const unsigned body = TypeRealizer::bodyIndex(ty);
+    uint64_t offset = DL.getStructLayout(realty)->getElementOffset(body);
+    llvm::Type* realcurr = realty->getElementType(body);
+    const GenType* curr = ty;
+
+    // Walk down the last fields until we hit the trailing array.
+    while(GenType::StructTypeID == curr->getTypeID()) {
+      const StructGenType* const structty = StructGenType::narrow(curr);
+      llvm::StructType* const realstruct =
+        llvm::cast<llvm::StructType>(realcurr);
+      const unsigned last = structty->numFields() - 1;
+
+      offset += DL.getStructLayout(realstruct)->getElementOffset(last);
+      realcurr = realstruct->getElementType(last);
+      curr = structty->fieldTy(last);
+    }
+
+    llvm::Type* const elemty =
+      llvm::cast<llvm::ArrayType>(realcurr)->getElementType();
+    llvm::Value* const elemsize =
+      llvm::ConstantInt::get(int64ty, DL.getTypeAllocSize(elemty), false);
+    const uint64_t align = DL.getABITypeAlignment(realty);
+    llvm::Value* const arrsize =
+      llvm::BinaryOperator::CreateNUWMul(len, elemsize, "", BB);
+    llvm::Value* const padding =
+      llvm::ConstantInt::get(int64ty, offset + align - 1, false);
+    llvm::Value* const mask =
+      llvm::ConstantInt::get(int64ty, ~(align - 1), false);
+    llvm::Value* const size =
+      llvm::BinaryOperator::CreateNUWAdd(arrsize, padding, "", BB);
+
+    return llvm::BinaryOperator::CreateAnd(size, mask, "", BB);
+  }
+}
+
+// The memory from core.gc.rawalloc isn't initialized, so the whole
+// object gets zeroed before the header goes in.  Otherwise the
+// collector could find garbage in the GC pointers of an object
+// which is only partly initialized when it gets to a safepoint.
+llvm::Function* AllocGenerator::generate(const GenType* const ty,
+                                         llvm::StructType* const realty,
+                                         const unsigned descidx,
+                                         llvm::Constant* const desc) {
+  llvm::LLVMContext& C = M.getContext();
+  const bool varsize = ty->isVariableSized();
+  llvm::Type* const argtys[2] = {
+    llvm::Type::getInt8PtrTy(C), llvm::Type::getInt64Ty(C)
+  };
+  llvm::ArrayRef<llvm::Type*> paramarr(argtys, varsize ? 2 : 1);
+  llvm::FunctionType* const functy =
+    llvm::FunctionType::get(realty->getPointerTo(), paramarr, false);
+  const std::string name = realty->getName().str() + ".alloc";
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::ExternalLinkage,
+                           name, &M);
+  llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Function::arg_iterator args = F->arg_begin();
+  llvm::Value* const gcctx = &*args++;
+  llvm::Value* const len = varsize ? &*args : NULL;
+  llvm::Value* const size = objSize(ty, realty, len, BB);
+  llvm::Value* const callargs[2] = { gcctx, size };
+  llvm::Value* const raw =
+    llvm::CallInst::Create(runtime.getRawAlloc(), callargs, "", BB);
+  llvm::Value* const setargs[5] = {
+    raw, llvm::ConstantInt::get(llvm::Type::getInt8Ty(C), 0, false), size,
+    llvm::ConstantInt::get(llvm::Type::getInt32Ty(C),
+                           M.getDataLayout().getABITypeAlignment(realty),
+                           false),
+    llvm::ConstantInt::getFalse(C)
+  };
+
+  llvm::CallInst::Create(llvm::Intrinsic::getDeclaration(
+                           &M, llvm::Intrinsic::memset, argtys),
+                         setargs, "", BB);
+
+  llvm::Value* const obj =
+    llvm::CastInst::CreatePointerCast(raw, realty->getPointerTo(), "", BB);
+
+  F->addFnAttr(llvm::Attribute::AlwaysInline);
+  header.init(obj, descidx, desc, BB);
+
+  if(varsize) {
+    llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, TypeRealizer::lengthIndex(), false)
+    };
+    llvm::Value* const lenaddr =
+      llvm::GetElementPtrInst::CreateInBounds(obj, idxs, "", BB);
+
+    new llvm::StoreInst(len, lenaddr, BB);
+  }
+
+  llvm::ReturnInst::Create(C, obj, BB);
+
+  return F;
+}
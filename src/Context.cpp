@@ -0,0 +1,180 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <stdio.h>
+#include <stdlib.h>
+#include "Context.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+
+llvm::StructType* Context::getLogEntryType() {
+  llvm::StructType* type = M.getTypeByName("core.gc.logentry");
+
+  if(NULL == type) {
+    llvm::LLVMContext& C = M.getContext();
+    llvm::Type* const fields[3] = {
+      llvm::Type::getInt8PtrTy(C), llvm::Type::getInt32Ty(C),
+      llvm::Type::getInt64Ty(C)
+    };
+
+    type = llvm::StructType::create(C, fields, "core.gc.logentry");
+  }
+
+  return type;
+}
+
+llvm::StructType* Context::getType() {
+  llvm::StructType* type = M.getTypeByName("core.gc.context");
+
+  if(NULL == type) {
+    llvm::SmallVector<llvm::Type*, 8> fields;
+
+    if(params.writeLogging) {
+      llvm::Type* const entryptrty = getLogEntryType()->getPointerTo();
+
+      fields.push_back(entryptrty);
+      fields.push_back(entryptrty);
+    }
+
+    if(params.cardMarking)
+      fields.push_back(llvm::Type::getInt8PtrTy(M.getContext()));
+
+    if(params.satbBarriers) {
+      llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(M.getContext());
+
+      fields.push_back(int8ptrty->getPointerTo());
+      fields.push_back(int8ptrty->getPointerTo());
+      fields.push_back(llvm::Type::getInt8Ty(M.getContext()));
+    }
+
+    fields.push_back(llvm::Type::getInt8PtrTy(M.getContext()));
+    fields.push_back(llvm::Type::getInt8PtrTy(M.getContext()));
+
+    if(params.doublePtrs)
+      fields.push_back(llvm::Type::getInt32Ty(M.getContext()));
+
+    fields.push_back(llvm::Type::getInt8Ty(M.getContext()));
+
+    type = llvm::StructType::create(M.getContext(), fields,
+                                    "core.gc.context");
+  }
+
+  return type;
+}
+
+llvm::GlobalVariable* Context::getCurrent() {
+  llvm::GlobalVariable* ctx = M.getGlobalVariable("core.gc.ctx");
+
+  if(NULL == ctx) {
+    llvm::PointerType* const ctxptrty = getType()->getPointerTo();
+
+    ctx = new llvm::GlobalVariable(M, ctxptrty, false,
+                                   llvm::GlobalValue::ExternalLinkage,
+                                   NULL, "core.gc.ctx", NULL,
+                                   llvm::GlobalValue::GeneralDynamicTLSModel);
+  }
+
+  return ctx;
+}
+
+unsigned Context::logCurIndex() const {
+  if(!params.writeLogging) {
+    fprintf(stderr, "Write log requested without write logging\n");
+    abort();
+  }
+
+  return 0;
+}
+
+unsigned Context::logEndIndex() const {
+  return logCurIndex() + 1;
+}
+
+unsigned Context::cardTableIndex() const {
+  if(!params.cardMarking) {
+    fprintf(stderr, "Card table requested without card marking\n");
+    abort();
+  }
+
+  return params.writeLogging ? logEndIndex() + 1 : 0;
+}
+
+unsigned Context::markCurIndex() const {
+  if(!params.satbBarriers) {
+    fprintf(stderr, "Mark queue requested without SATB barriers\n");
+    abort();
+  }
+
+  return (params.writeLogging ? 2 : 0) + (params.cardMarking ? 1 : 0);
+}
+
+unsigned Context::markEndIndex() const {
+  return markCurIndex() + 1;
+}
+
+unsigned Context::markingIndex() const {
+  return markCurIndex() + 2;
+}
+
+unsigned Context::heapStartIndex() const {
+  return (params.writeLogging ? 2 : 0) + (params.cardMarking ? 1 : 0) +
+    (params.satbBarriers ? 3 : 0);
+}
+
+unsigned Context::heapEndIndex() const {
+  return heapStartIndex() + 1;
+}
+
+unsigned Context::heapSlotIndex() const {
+  if(!params.doublePtrs) {
+    fprintf(stderr, "Heap slot requested without double pointers\n");
+    abort();
+  }
+
+  return heapEndIndex() + 1;
+}
+
+unsigned Context::pollIndex() const {
+  return heapEndIndex() + (params.doublePtrs ? 2 : 1);
+}
+
+llvm::Value* Context::fieldAddr(llvm::Value* const ctx,
+                                const unsigned idx,
+                                llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(M.getContext());
+  llvm::Value* idxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    llvm::ConstantInt::get(int32ty, idx, false)
+  };
+
+  return llvm::GetElementPtrInst::CreateInBounds(ctx, idxs, "", BB);
+}
+
+llvm::Value* Context::heapSlotAddr(llvm::Value* const ctx,
+                                   llvm::Value* const ptr,
+                                   llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(M.getContext());
+  llvm::Value* const sel =
+    new llvm::LoadInst(fieldAddr(ctx, heapSlotIndex(), BB), "", BB);
+  llvm::Value* idxs[2] = { llvm::ConstantInt::get(int32ty, 0, false), sel };
+
+  return llvm::GetElementPtrInst::CreateInBounds(ptr, idxs, "", BB);
+}
@@ -0,0 +1,439 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <stdio.h>
+#include <stdlib.h>
+#include "TraceGenerator.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/Support/MathExtras.h"
+
+// Fields which can be part of a memcpy.  Variable-sized fields are
+// left to the array loop, which knows the length.
+static inline bool coalescible(const GenType* const ty) {
+  return !ty->isVariableSized() && !ty->hasGCPtrs();
+}
+
+static void memCopy(llvm::Module& M,
+                    llvm::BasicBlock* const BB,
+                    llvm::Value* const src,
+                    llvm::Value* const dst,
+                    const uint64_t size,
+                    const unsigned align) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const tys[3] = { int8ptrty, int8ptrty, int64ty };
+  llvm::Function* const F =
+    llvm::Intrinsic::getDeclaration(&M, llvm::Intrinsic::memcpy, tys);
+  llvm::Value* const args[5] = {
+    llvm::CastInst::CreatePointerCast(dst, int8ptrty, "", BB),
+    llvm::CastInst::CreatePointerCast(src, int8ptrty, "", BB),
+    llvm::ConstantInt::get(int64ty, size, false),
+    llvm::ConstantInt::get(llvm::Type::getInt32Ty(C), align, false),
+    llvm::ConstantInt::getFalse(C)
+  };
+
+  llvm::CallInst::Create(F, args, "", BB);
+}
+
+void CopyCodeGen::copy(llvm::Value* const src,
+                       llvm::Value* const dst) {
+  llvm::Value* const val = new llvm::LoadInst(src, "", BB);
+
+  new llvm::StoreInst(val, dst, BB);
+}
+
+// Only strong, mobile pointers actually cause evacuation.  Immobile
+// objects stay where they are, but still have to be marked.  Weaker
+// pointers don't keep their referents alive, so they only get
+// updated if the referent was copied on account of something else.
+// If it hasn't been yet, the field is handed to the runtime, which
+// revisits it once tracing is done.  Pointers outside the collected
+// heap, null included, are left as they are.
+llvm::Value* CopyCodeGen::evacuate(const GCPtrGenType* const gcty,
+                                   llvm::Value* const ptr,
+                                   llvm::Value* const field) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::PointerType* const ptrty =
+    llvm::cast<llvm::PointerType>(ptr->getType());
+  llvm::PointerType* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::BasicBlock* const entryBB = BB;
+  llvm::BasicBlock* const liveBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const fwdBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const evacBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const doneBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Value* const raw =
+    llvm::CastInst::CreatePointerCast(ptr, int8ptrty, "", entryBB);
+
+  llvm::BranchInst::Create(liveBB, doneBB, inHeap(raw, entryBB), entryBB);
+
+  // Check the forwarding bit
+  llvm::BranchInst::Create(fwdBB, evacBB, header.isForwarded(raw, liveBB),
+                           liveBB);
+
+  // Already copied
+  llvm::Value* const fwd = header.getForward(raw, fwdBB);
+
+  llvm::BranchInst::Create(doneBB, fwdBB);
+
+  // Not copied yet
+  llvm::BasicBlock* endBB = evacBB;
+  llvm::Value* moved = raw;
+
+  if(GCPtrGenType::StrongPtr == gcty->getPtrClass()) {
+    llvm::Value* const args[2] = { gcctx, raw };
+
+    if(GCPtrGenType::Mobile != gcty->getMobility())
+      llvm::CallInst::Create(runtime.getMark(), args, "", evacBB);
+    else if(params.parallelCopy)
+      moved = parallelEvacuate(raw, endBB);
+    else
+      moved = llvm::CallInst::Create(runtime.getEvacuate(), args, "", evacBB);
+  }
+  else {
+    llvm::Value* const args[2] = {
+      gcctx, llvm::CastInst::CreatePointerCast(field, int8ptrty, "", evacBB)
+    };
+
+    llvm::CallInst::Create(runtime.getWeakRef(), args, "", evacBB);
+  }
+
+  llvm::BranchInst::Create(doneBB, endBB);
+
+  // Merge the results
+  llvm::PHINode* const out = llvm::PHINode::Create(int8ptrty, 3, "", doneBB);
+
+  out->addIncoming(raw, entryBB);
+  out->addIncoming(fwd, fwdBB);
+  out->addIncoming(moved, endBB);
+  BB = doneBB;
+
+  return llvm::CastInst::CreatePointerCast(out, ptrty, "", BB);
+}
+
+// Reserve a copy, and race to install it.  The winner queues its copy
+// to be scanned, and the losers give theirs back.
+llvm::Value* CopyCodeGen::parallelEvacuate(llvm::Value* const raw,
+                                           llvm::BasicBlock*& curBB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Function* const F = curBB->getParent();
+  llvm::Value* const args[2] = { gcctx, raw };
+  llvm::Value* const copy =
+    llvm::CallInst::Create(runtime.getReserve(), args, "", curBB);
+  llvm::Value* const winner = header.casForward(raw, copy, curBB);
+  llvm::BasicBlock* const wonBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const lostBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const joinBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Value* const won =
+    new llvm::ICmpInst(*curBB, llvm::CmpInst::ICMP_EQ, winner, copy, "");
+  llvm::Value* const copyargs[2] = { gcctx, copy };
+
+  llvm::BranchInst::Create(wonBB, lostBB, won, curBB);
+  llvm::CallInst::Create(runtime.getEnqueue(), copyargs, "", wonBB);
+  llvm::BranchInst::Create(joinBB, wonBB);
+  llvm::CallInst::Create(runtime.getUnreserve(), copyargs, "", lostBB);
+  llvm::BranchInst::Create(joinBB, lostBB);
+  curBB = joinBB;
+
+  return winner;
+}
+
+void CopyCodeGen::copyWhole(llvm::Value* const src,
+                            llvm::Value* const dst) {
+  const llvm::DataLayout& DL = M.getDataLayout();
+  llvm::Type* const ty =
+    llvm::cast<llvm::PointerType>(src->getType())->getElementType();
+
+  memCopy(M, BB, src, dst, DL.getTypeAllocSize(ty),
+          DL.getABITypeAlignment(ty));
+}
+
+// The run covers the fields themselves and any padding between them.
+// The alignment is whatever the structure's alignment guarantees at
+// the offset of the first field.
+void CopyCodeGen::copyRange(const struct IndexState& ctx,
+                            const unsigned first,
+                            const unsigned last) {
+  const llvm::DataLayout& DL = M.getDataLayout();
+  llvm::PointerType* const ptrty =
+    llvm::cast<llvm::PointerType>(ctx.src->getType());
+  llvm::StructType* const structty =
+    llvm::cast<llvm::StructType>(ptrty->getElementType());
+  const llvm::StructLayout* const layout = DL.getStructLayout(structty);
+  const uint64_t start = layout->getElementOffset(first);
+  const uint64_t end = layout->getElementOffset(last) +
+    DL.getTypeAllocSize(structty->getElementType(last));
+  const unsigned align =
+    llvm::MinAlign(DL.getABITypeAlignment(structty), start);
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(M.getContext());
+  llvm::Value* idxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    llvm::ConstantInt::get(int32ty, first, false)
+  };
+  llvm::Value* const src =
+    llvm::GetElementPtrInst::CreateInBounds(ctx.src, idxs, "", BB);
+  llvm::Value* const dst =
+    llvm::GetElementPtrInst::CreateInBounds(ctx.dst, idxs, "", BB);
+
+  memCopy(M, BB, src, dst, end - start, align);
+}
+
+llvm::FunctionType* CopyCodeGen::getCopyFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[3] = { int8ptrty, int8ptrty, int8ptrty };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+llvm::FunctionType* CopyCodeGen::getClusterFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const argtys[5] = {
+    int8ptrty, int8ptrty, int8ptrty, int64ty, int64ty
+  };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+llvm::Function* CopyCodeGen::generate(const GenType* const ty,
+                                      llvm::StructType* const realty) {
+  llvm::LLVMContext& C = M.getContext();
+  const std::string name = realty->getName().str() + ".copy";
+  llvm::Function* const F =
+    llvm::Function::Create(getCopyFuncType(),
+                           llvm::GlobalValue::ExternalLinkage, name, &M);
+  llvm::Function::arg_iterator args = F->arg_begin();
+
+  BB = llvm::BasicBlock::Create(C, "", F);
+  gcctx = &*args++;
+
+  llvm::Value* const src =
+    llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const dst =
+    llvm::CastInst::CreatePointerCast(&*args, realty->getPointerTo(),
+                                      "", BB);
+
+  clustered = params.clusterize ? clusterArray(ty) : NULL;
+  traverse(ty, src, dst);
+  llvm::ReturnInst::Create(C, BB);
+  clustered = NULL;
+  gcctx = NULL;
+  BB = NULL;
+
+  return F;
+}
+
+llvm::Function* CopyCodeGen::generateCluster(const GenType* const ty,
+                                             llvm::StructType* const realty) {
+  if(!params.clusterize || NULL == clusterArray(ty))
+    return NULL;
+  else {
+    llvm::LLVMContext& C = M.getContext();
+    const std::string name = realty->getName().str() + ".copy.cluster";
+    llvm::Function* const F =
+      llvm::Function::Create(getClusterFuncType(),
+                             llvm::GlobalValue::ExternalLinkage, name, &M);
+    llvm::Function::arg_iterator args = F->arg_begin();
+
+    BB = llvm::BasicBlock::Create(C, "", F);
+    gcctx = &*args++;
+
+    llvm::Value* const src =
+      llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                        "", BB);
+    llvm::Value* const dst =
+      llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                        "", BB);
+    llvm::Value* const start = &*args++;
+    llvm::Value* const end = &*args;
+
+    traverseRange(ty, src, dst, start, end);
+    llvm::ReturnInst::Create(C, BB);
+    gcctx = NULL;
+    BB = NULL;
+
+    return F;
+  }
+}
+
+bool CopyCodeGen::begin(const StructGenType* const gcty,
+                        struct IndexState& ctx,
+                        struct IndexState& parent) {
+  if(CopyGCTraceGen::begin(gcty, ctx, parent)) {
+    const unsigned nfields = gcty->numFields();
+    unsigned i = 0;
+
+    while(i < nfields) {
+      unsigned end = i;
+
+      while(end < nfields && coalescible(gcty->fieldTy(end)) &&
+            clustered != gcty->fieldTy(end))
+        end++;
+
+      if(end != i) {
+        copyRange(ctx, i, end - 1);
+        i = end;
+      }
+      else {
+        ctx.idx = i;
+        gcty->fieldTy(i++)->accept(*this, ctx);
+      }
+    }
+  }
+
+  return false;
+}
+
+bool CopyCodeGen::begin(const ArrayGenType* const gcty,
+                        struct IndexState& ctx,
+                        struct IndexState& parent) {
+  if(coalescible(gcty) && clustered != gcty) {
+    llvm::Value* src;
+    llvm::Value* dst;
+
+    getSrcDst(BB, parent, src, dst);
+    copyWhole(src, dst);
+    ctx.loopidx = NULL;
+
+    return false;
+  }
+  else
+    return CopyGCTraceGen::begin(gcty, ctx, parent);
+}
+
+void CopyCodeGen::setDescTable(llvm::GlobalVariable* const table,
+                               const llvm::StringMap<unsigned>* const idxs) {
+  desctable = table;
+  descidxs = idxs;
+}
+
+// The runtime only fills in the header of the object itself, so the
+// destination's inlined headers would otherwise be uninitialized.
+// The source's inlined header is never looked at otherwise, so it
+// gets forwarded to the destination's, which lets writes logged
+// against the interior address find their way to the copy.
+void CopyCodeGen::inlinedHeader(const GCPtrGenType* const gcty,
+                                llvm::Value* const src,
+                                llvm::Value* const dst) {
+  const llvm::StringRef name =
+    llvm::cast<llvm::StructType>(gcty->getElemTy())->getName();
+
+  if(NULL == desctable || NULL == descidxs || !descidxs->count(name)) {
+    fprintf(stderr, "No type descriptor for inlined type %s\n",
+            name.str().c_str());
+    abort();
+  }
+
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(M.getContext());
+  const unsigned descidx = descidxs->lookup(name);
+  llvm::Constant* const idxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    llvm::ConstantInt::get(int32ty, descidx, false)
+  };
+  llvm::Constant* const desc =
+    llvm::ConstantExpr::getInBoundsGetElementPtr(desctable->getType()->
+                                                   getElementType(),
+                                                 desctable, idxs);
+
+  header.init(dst, descidx, desc, BB);
+  header.setForward(src, dst, BB);
+}
+
+// Slots pointing into the collected heap get overwritten with their
+// new addresses when they are visited.
+void CopyCodeGen::filteredBlock(llvm::Value* const vec,
+                                llvm::Value* const dst) {
+  const llvm::DataLayout& DL = M.getDataLayout();
+  llvm::VectorType* const vecty = llvm::cast<llvm::VectorType>(vec->getType());
+  llvm::StoreInst* const store = new llvm::StoreInst(vec, dst, BB);
+
+  store->setAlignment(DL.getABITypeAlignment(vecty->getElementType()));
+}
+
+bool CopyCodeGen::descend(const StructGenType*) {
+  return true;
+}
+
+bool CopyCodeGen::descend(const ArrayGenType*) {
+  return true;
+}
+
+void CopyCodeGen::visit(const NativePtrGenType*,
+                        llvm::Value* const src,
+                        llvm::Value* const dst) {
+  copy(src, dst);
+}
+
+// With double pointers, the pointer is read from the slot for the
+// heap being copied from, and the same translated pointer goes in
+// both slots of the copy.
+void CopyCodeGen::visit(const GCPtrGenType* const gcty,
+                        llvm::Value* const src,
+                        llvm::Value* const dst) {
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(M.getContext());
+  llvm::Value* srcslot = src;
+
+  if(params.doublePtrs) {
+    Context context(M, params);
+    llvm::Value* const ctx =
+      llvm::CastInst::CreatePointerCast(gcctx,
+                                        context.getType()->getPointerTo(),
+                                        "", BB);
+
+    srcslot = context.heapSlotAddr(ctx, src, BB);
+  }
+
+  llvm::Value* const ptr = new llvm::LoadInst(srcslot, "", BB);
+  llvm::Value* const newptr = evacuate(gcty, ptr, dst);
+
+  if(params.doublePtrs)
+    for(unsigned i = 0; i < 2; i++) {
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, i, false)
+      };
+      llvm::Value* const slot =
+        llvm::GetElementPtrInst::CreateInBounds(dst, idxs, "", BB);
+
+      new llvm::StoreInst(newptr, slot, BB);
+    }
+  else
+    new llvm::StoreInst(newptr, dst, BB);
+}
+
+void CopyCodeGen::visit(const PrimGenType*,
+                        llvm::Value* const src,
+                        llvm::Value* const dst) {
+  copy(src, dst);
+}
+
+void CopyCodeGen::visit(const FuncPtrGenType*,
+                        llvm::Value* const src,
+                        llvm::Value* const dst) {
+  copy(src, dst);
+}
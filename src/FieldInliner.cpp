@@ -0,0 +1,107 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "FieldInliner.h"
+#include "LeafEnumerator.h"
+#include "llvm/IR/DerivedTypes.h"
+
+// Only objects which are immutable all the way through get inlined,
+// so that the only writes through the address of an inlined object
+// are the initializing ones.  Inlined pointers inside the pointee
+// are leaves here, and get checked when they are considered.
+const GenType* FieldInliner::candidate(const GCPtrGenType* const ty) const {
+  if(GenType::Immutable != ty->mutability() ||
+     GCPtrGenType::Unique != ty->getOwnership() ||
+     GCPtrGenType::StrongPtr != ty->getPtrClass() ||
+     GCPtrGenType::Mobile != ty->getMobility())
+    return NULL;
+
+  const llvm::StructType* const structty =
+    llvm::dyn_cast<llvm::StructType>(ty->getElemTy());
+
+  if(NULL == structty || !structty->hasName())
+    return NULL;
+
+  llvm::StringMap<const GenType*>::const_iterator it =
+    types.find(structty->getName());
+
+  if(types.end() == it || it->getValue()->isVariableSized())
+    return NULL;
+
+  std::vector<Leaf> leaves;
+
+  LeafEnumerator().enumerate(it->getValue(), leaves);
+
+  for(unsigned i = 0; i < leaves.size(); i++)
+    if(GenType::Immutable != leaves[i].mutability)
+      return NULL;
+
+  return it->getValue();
+}
+
+bool FieldInliner::reaches(const GenType* const ty,
+                           const GenType* const target,
+                           llvm::SmallPtrSet<const GenType*, 8>& visited)
+  const {
+  switch(ty->getTypeID()) {
+  default: return false;
+  case GenType::ArrayTypeID:
+    return reaches(ArrayGenType::narrow(ty)->getElemTy(), target, visited);
+  case GenType::StructTypeID: {
+    const StructGenType* const structty = StructGenType::narrow(ty);
+
+    for(unsigned i = 0; i < structty->numFields(); i++)
+      if(reaches(structty->fieldTy(i), target, visited))
+        return true;
+
+    return false;
+  }
+  case GenType::GCPtrTypeID: {
+    const GenType* const pointee = candidate(GCPtrGenType::narrow(ty));
+
+    if(NULL == pointee)
+      return false;
+    else if(target == pointee)
+      return true;
+    else if(!visited.insert(pointee).second)
+      return false;
+    else
+      return reaches(pointee, target, visited);
+  }
+  }
+}
+
+// Recursive types can't be inlined, or the realization would be
+// infinite.
+const GenType* FieldInliner::getInlined(const GCPtrGenType* const ty) const {
+  if(!params.inlineFields)
+    return NULL;
+
+  const GenType* const pointee = candidate(ty);
+
+  if(NULL != pointee) {
+    llvm::SmallPtrSet<const GenType*, 8> visited;
+
+    if(!reaches(pointee, pointee, visited))
+      return pointee;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,284 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "GCHeader.h"
+#include "llvm/IR/Instructions.h"
+
+llvm::StructType* GCHeader::getType() {
+  if(NULL == type) {
+    llvm::LLVMContext& C = M.getContext();
+
+    type = M.getTypeByName("core.gc.header");
+
+    if(NULL == type) {
+      llvm::Type* fields[3];
+      unsigned nfields;
+
+      if(params.compactHeaders) {
+        fields[0] = llvm::Type::getInt64Ty(C);
+        nfields = 1;
+      }
+      else {
+        fields[0] = llvm::Type::getInt8PtrTy(C);
+        fields[1] = llvm::Type::getInt32Ty(C);
+        nfields = 2;
+
+        if(params.generational)
+          fields[nfields++] = llvm::Type::getInt32Ty(C);
+      }
+
+      llvm::ArrayRef<llvm::Type*> fieldarr(fields, nfields);
+
+      type = llvm::StructType::create(C, fieldarr, "core.gc.header");
+    }
+  }
+
+  return type;
+}
+
+llvm::Value* GCHeader::fieldAddr(llvm::Value* const obj,
+                                 const unsigned idx,
+                                 llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  // The header is always the first thing in an object, so we can
+  // get at it with a cast.
+  llvm::Value* const hdr =
+    llvm::CastInst::CreatePointerCast(obj, getType()->getPointerTo(),
+                                      "", BB);
+  llvm::Value* idxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    llvm::ConstantInt::get(int32ty, idx, false)
+  };
+
+  return llvm::GetElementPtrInst::CreateInBounds(hdr, idxs, "", BB);
+}
+
+void GCHeader::init(llvm::Value* const obj,
+                    const unsigned descidx,
+                    llvm::Constant* const desc,
+                    llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = M.getContext();
+
+  if(params.compactHeaders) {
+    llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+    const uint64_t word = (uint64_t)descidx << descShift;
+
+    new llvm::StoreInst(llvm::ConstantInt::get(int64ty, word, false),
+                        fieldAddr(obj, 0, BB), BB);
+  }
+  else {
+    llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::Value* const constzero = llvm::ConstantInt::get(int32ty, 0, false);
+    llvm::Value* const descptr =
+      llvm::ConstantExpr::getPointerCast(desc, llvm::Type::getInt8PtrTy(C));
+
+    new llvm::StoreInst(descptr, fieldAddr(obj, 0, BB), BB);
+    new llvm::StoreInst(constzero, fieldAddr(obj, 1, BB), BB);
+
+    if(params.generational)
+      new llvm::StoreInst(constzero, fieldAddr(obj, 2, BB), BB);
+  }
+}
+
+// Both header layouts keep the forwarded bit in the flags, which is
+// the first word of compact headers and the second field otherwise.
+// With parallel copying, the load has to synchronize with the store
+// that set the bit, so the forwarding address can be read safely.
+llvm::Value* GCHeader::isForwarded(llvm::Value* const obj,
+                                   llvm::BasicBlock* const BB) {
+  llvm::Value* const flagsaddr =
+    fieldAddr(obj, params.compactHeaders ? 0 : 1, BB);
+  llvm::Value* const flags = params.parallelCopy ?
+    new llvm::LoadInst(flagsaddr, "", false, params.compactHeaders ? 8 : 4,
+                       llvm::Acquire, llvm::CrossThread, BB) :
+    new llvm::LoadInst(flagsaddr, "", BB);
+  llvm::Type* const flagsty = flags->getType();
+  llvm::Value* const bit =
+    llvm::BinaryOperator::CreateAnd(flags,
+                                    llvm::ConstantInt::get(flagsty,
+                                                           1 << forwardBit,
+                                                           false),
+                                    "", BB);
+
+  return new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_NE, bit,
+                            llvm::ConstantInt::get(flagsty, 0, false), "");
+}
+
+llvm::Value* GCHeader::getForward(llvm::Value* const obj,
+                                  llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Value* const addr = fieldAddr(obj, 0, BB);
+  llvm::Value* const word = new llvm::LoadInst(addr, "", BB);
+
+  if(params.compactHeaders) {
+    llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+    llvm::Value* const masked =
+      llvm::BinaryOperator::CreateAnd(word,
+                                      llvm::ConstantInt::get(int64ty,
+                                                             ~((uint64_t)1 <<
+                                                               forwardBit),
+                                                             false),
+                                      "", BB);
+
+    return new llvm::IntToPtrInst(masked, llvm::Type::getInt8PtrTy(C),
+                                  "", BB);
+  }
+  else
+    return word;
+}
+
+void GCHeader::setForward(llvm::Value* const obj,
+                          llvm::Value* const fwd,
+                          llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = M.getContext();
+
+  if(params.compactHeaders) {
+    llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+    llvm::Value* const addr =
+      new llvm::PtrToIntInst(fwd, int64ty, "", BB);
+    llvm::Value* const word =
+      llvm::BinaryOperator::CreateOr(addr,
+                                     llvm::ConstantInt::get(int64ty,
+                                                            1 << forwardBit,
+                                                            false),
+                                     "", BB);
+
+    new llvm::StoreInst(word, fieldAddr(obj, 0, BB), BB);
+  }
+  else {
+    llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::Value* const fwdptr =
+      llvm::CastInst::CreatePointerCast(fwd, llvm::Type::getInt8PtrTy(C),
+                                        "", BB);
+    llvm::Value* const flagsaddr = fieldAddr(obj, 1, BB);
+    llvm::Value* const flags = new llvm::LoadInst(flagsaddr, "", BB);
+    llvm::Value* const newflags =
+      llvm::BinaryOperator::CreateOr(flags,
+                                     llvm::ConstantInt::get(int32ty,
+                                                            1 << forwardBit,
+                                                            false),
+                                     "", BB);
+
+    new llvm::StoreInst(fwdptr, fieldAddr(obj, 0, BB), BB);
+    new llvm::StoreInst(newflags, flagsaddr, BB);
+  }
+}
+
+// Compact headers hold everything in one word, so a single
+// compare-and-swap does the job.  Otherwise, claim the object with
+// the busy bit, and spin while some other thread has it claimed.
+// Either way, a failed compare-and-swap goes back to the top to look
+// at the header again.
+llvm::Value* GCHeader::casForward(llvm::Value* const obj,
+                                  llvm::Value* const fwd,
+                                  llvm::BasicBlock*& BB) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::PointerType* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::BasicBlock* const retryBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const lostBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const claimBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const wonBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const doneBB = llvm::BasicBlock::Create(C, "", F);
+  const unsigned flagsidx = params.compactHeaders ? 0 : 1;
+  llvm::Value* const flagsaddr = fieldAddr(obj, flagsidx, BB);
+
+  llvm::BranchInst::Create(retryBB, BB);
+
+  // Look at the header, and give up if it's already forwarded
+  llvm::LoadInst* const flags =
+    new llvm::LoadInst(flagsaddr, "", false, params.compactHeaders ? 8 : 4,
+                       llvm::Acquire, llvm::CrossThread, retryBB);
+  llvm::IntegerType* const flagsty =
+    llvm::cast<llvm::IntegerType>(flags->getType());
+  llvm::Value* const constfwd =
+    llvm::ConstantInt::get(flagsty, 1 << forwardBit, false);
+  llvm::Value* const fwdbit =
+    llvm::BinaryOperator::CreateAnd(flags, constfwd, "", retryBB);
+  llvm::Value* const forwarded =
+    new llvm::ICmpInst(*retryBB, llvm::CmpInst::ICMP_NE, fwdbit,
+                       llvm::ConstantInt::get(flagsty, 0, false), "");
+
+  llvm::BranchInst::Create(lostBB, claimBB, forwarded, retryBB);
+
+  // Someone else got there first
+  llvm::Value* const winner = getForward(obj, lostBB);
+
+  llvm::BranchInst::Create(doneBB, lostBB);
+
+  // Try to install the forwarding address
+  if(params.compactHeaders) {
+    llvm::Value* const word =
+      llvm::BinaryOperator::CreateOr(new llvm::PtrToIntInst(fwd, flagsty,
+                                                            "", claimBB),
+                                     constfwd, "", claimBB);
+    llvm::Value* const cas =
+      new llvm::AtomicCmpXchgInst(flagsaddr, flags, word,
+                                  llvm::AcquireRelease, llvm::Acquire,
+                                  llvm::CrossThread, claimBB);
+    llvm::Value* const success =
+      llvm::ExtractValueInst::Create(cas, 1, "", claimBB);
+
+    llvm::BranchInst::Create(wonBB, retryBB, success, claimBB);
+  }
+  else {
+    llvm::BasicBlock* const casBB = llvm::BasicBlock::Create(C, "", F);
+    llvm::Value* const constbusy =
+      llvm::ConstantInt::get(flagsty, 1 << busyBit, false);
+    llvm::Value* const busybit =
+      llvm::BinaryOperator::CreateAnd(flags, constbusy, "", claimBB);
+    llvm::Value* const busy =
+      new llvm::ICmpInst(*claimBB, llvm::CmpInst::ICMP_NE, busybit,
+                         llvm::ConstantInt::get(flagsty, 0, false), "");
+
+    llvm::BranchInst::Create(retryBB, casBB, busy, claimBB);
+
+    llvm::Value* const claimed =
+      llvm::BinaryOperator::CreateOr(flags, constbusy, "", casBB);
+    llvm::Value* const cas =
+      new llvm::AtomicCmpXchgInst(flagsaddr, flags, claimed,
+                                  llvm::Acquire, llvm::Monotonic,
+                                  llvm::CrossThread, casBB);
+    llvm::Value* const success =
+      llvm::ExtractValueInst::Create(cas, 1, "", casBB);
+
+    llvm::BranchInst::Create(wonBB, retryBB, success, casBB);
+
+    // Write the forwarding address, then publish it
+    llvm::Value* const published =
+      llvm::BinaryOperator::CreateOr(flags, constfwd, "", wonBB);
+
+    new llvm::StoreInst(fwd, fieldAddr(obj, 0, wonBB), wonBB);
+    new llvm::StoreInst(published, flagsaddr, false, 4, llvm::Release,
+                        llvm::CrossThread, wonBB);
+  }
+
+  llvm::BranchInst::Create(doneBB, wonBB);
+
+  // Merge the results
+  llvm::PHINode* const out = llvm::PHINode::Create(int8ptrty, 2, "", doneBB);
+
+  out->addIncoming(winner, lostBB);
+  out->addIncoming(fwd, wonBB);
+  BB = doneBB;
+
+  return out;
+}
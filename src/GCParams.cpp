@@ -0,0 +1,102 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "GCParams.h"
+#include "llvm/Support/CommandLine.h"
+
+const unsigned GCParams::clusterSize = 1024;
+const unsigned GCParams::cardShift = 9;
+
+static llvm::cl::opt<bool>
+WriteLogging("core-gc-write-logging",
+             llvm::cl::desc("Generate write logging"));
+
+static llvm::cl::opt<bool>
+ReadBarriers("core-gc-read-barriers",
+             llvm::cl::desc("Generate read barriers"));
+
+static llvm::cl::opt<bool>
+Clusterize("core-gc-clusterize",
+           llvm::cl::desc("Trace and copy large arrays in clusters"));
+
+static llvm::cl::opt<bool>
+Generational("core-gc-generational",
+             llvm::cl::desc("Add fields for generational GC"));
+
+static llvm::cl::opt<bool>
+DoublePtrs("core-gc-double-ptrs",
+           llvm::cl::desc("Represent GC pointers with double pointers"));
+
+static llvm::cl::opt<bool>
+CopyFuncs("core-gc-copy-funcs",
+          llvm::cl::desc("Generate copy functions"));
+
+static llvm::cl::opt<bool>
+MoveFuncs("core-gc-move-funcs",
+          llvm::cl::desc("Generate move functions"));
+
+static llvm::cl::opt<bool>
+TraceFuncs("core-gc-trace-funcs",
+           llvm::cl::desc("Generate trace functions"));
+
+static llvm::cl::opt<bool>
+CompactHeaders("core-gc-compact-headers",
+               llvm::cl::desc("Pack object headers into a single word"));
+
+static llvm::cl::opt<bool>
+InlineFields("core-gc-inline-fields",
+             llvm::cl::desc("Inline immutable, unique GC pointers"));
+
+static llvm::cl::opt<unsigned>
+PrefetchDistance("core-gc-prefetch-distance", llvm::cl::init(0),
+                 llvm::cl::desc("Array elements ahead to prefetch"));
+
+static llvm::cl::opt<bool>
+ParallelCopy("core-gc-parallel-copy",
+             llvm::cl::desc("Forward objects atomically"));
+
+static llvm::cl::opt<bool>
+CardMarking("core-gc-card-marking",
+            llvm::cl::desc("Mark cards on GC pointer writes"));
+
+static llvm::cl::opt<bool>
+SATBBarriers("core-gc-satb-barriers",
+             llvm::cl::desc("Generate snapshot-at-the-beginning barriers"));
+
+static llvm::cl::opt<unsigned>
+PollStride("core-gc-poll-stride", llvm::cl::init(0),
+           llvm::cl::desc("Counted loop iterations between safepoint "
+                          "polls (a power of two)"));
+
+static llvm::cl::opt<unsigned>
+SafepointBudget("core-gc-safepoint-budget", llvm::cl::init(0),
+                llvm::cl::desc("Instructions within which a safepoint "
+                               "makes a later one redundant"));
+
+const GCParams& GCParams::fromFlags() {
+  static const GCParams params(WriteLogging, ReadBarriers, Clusterize,
+                               Generational, DoublePtrs, CopyFuncs,
+                               MoveFuncs, TraceFuncs, CompactHeaders,
+                               InlineFields, PrefetchDistance,
+                               ParallelCopy, CardMarking, SATBBarriers,
+                               PollStride, SafepointBudget);
+
+  return params;
+}
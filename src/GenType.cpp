@@ -104,6 +104,48 @@ bool GenType::operator==(const GenType& other) const {
   return false;
 }
 
+bool GenType::hasGCPtrs() const {
+  if(-1 == gcptrs) {
+    bool out = false;
+
+    switch(getTypeID()) {
+    default: break;
+    case GCPtrTypeID:
+      out = true;
+      break;
+    case ArrayTypeID:
+      out = ArrayGenType::narrow(this)->getElemTy()->hasGCPtrs();
+      break;
+    case StructTypeID: {
+      const StructGenType* const structty = StructGenType::narrow(this);
+
+      for(unsigned i = 0; i < structty->numFields() && !out; i++)
+        out = structty->fieldTy(i)->hasGCPtrs();
+
+      break;
+    }
+    }
+
+    gcptrs = out;
+  }
+
+  return gcptrs;
+}
+
+bool GenType::isVariableSized() const {
+  switch(getTypeID()) {
+  default: return false;
+  case ArrayTypeID:
+    return !ArrayGenType::narrow(this)->isSized();
+  case StructTypeID: {
+    const StructGenType* const structty = StructGenType::narrow(this);
+    const unsigned nfields = structty->numFields();
+
+    return 0 != nfields && structty->fieldTy(nfields - 1)->isVariableSized();
+  }
+  }
+}
+
 // Format: GEN_TYPE_FUNC vararg retty paramty*
 const FuncPtrGenType* FuncPtrGenType::get(const llvm::Module& M,
                                           const llvm::MDNode* const md,
@@ -136,7 +178,7 @@ const StructGenType* StructGenType::get(const llvm::Module& M,
   for(unsigned i = 2; i < operands; i++) {
     const llvm::MDNode* const fielddesc =
       llvm::cast<llvm::MDNode>(md->getOperand(i));
-    const unsigned mutability = getMDIntArg(md, 0);
+    const unsigned mutability = getMDIntArg(fielddesc, 0);
     const llvm::MDNode* const typedesc =
       llvm::cast<llvm::MDNode>(fielddesc->getOperand(1));
 
@@ -146,21 +188,54 @@ const StructGenType* StructGenType::get(const llvm::Module& M,
   return new StructGenType(fieldtys, operands - 2, packed, mut);
 }
 
-// Format: GEN_TYPE_ARRAY inner [size]
+static inline ArrayGenType::Layout decodeLayout(const unsigned layout) {
+  switch(layout) {
+  default:
+    fprintf(stderr, "Bad array layout code %d\n", layout);
+    abort();
+  case ARRAY_LAYOUT_AOS: return ArrayGenType::AoS;
+  case ARRAY_LAYOUT_SOA: return ArrayGenType::SoA;
+  }
+}
+
+// Structure-of-arrays layout only works if every field of the
+// element can be made into a column.
+static bool isFlatStruct(const GenType* const ty) {
+  const StructGenType* const structty = StructGenType::narrow(ty);
+
+  if(NULL == structty)
+    return false;
+
+  for(unsigned i = 0; i < structty->numFields(); i++)
+    switch(structty->fieldTy(i)->getTypeID()) {
+    default: break;
+    case GenType::StructTypeID:
+    case GenType::ArrayTypeID:
+      return false;
+    }
+
+  return true;
+}
+
+// Format: GEN_TYPE_ARRAY inner [size [layout]]
 const ArrayGenType* ArrayGenType::get(const llvm::Module& M,
                                       const llvm::MDNode* const md,
                                       const Mutability mut) {
   const llvm::MDNode* const inner =
     llvm::cast<llvm::MDNode>(md->getOperand(1));
   const GenType* const innerty = GenType::get(M, inner, mut);
+  const unsigned operands = md->getNumOperands();
+  const unsigned size = 3 <= operands ? getMDIntArg(md, 2) : 0;
+  const Layout layout =
+    4 <= operands ? decodeLayout(getMDIntArg(md, 3)) : AoS;
 
-  if(3 == md->getNumOperands()) {
-    const unsigned size = getMDIntArg(md, 2);
-
-    return new ArrayGenType(innerty, size, mut);
+  if(SoA == layout && (0 == size || !isFlatStruct(innerty))) {
+    fprintf(stderr, "Structure-of-arrays layout requires a sized array "
+            "of flat structures\n");
+    abort();
   }
-  else
-    return new ArrayGenType(innerty, 0, mut);
+
+  return new ArrayGenType(innerty, size, mut, layout);
 }
 
 // Format: GEN_TYPE_NATIVEPTR inner
@@ -197,7 +272,27 @@ static inline GCPtrGenType::PtrClass decodePtrClass(const unsigned mut) {
   }
 }
 
-// Format: GEN_TYPE_GCPTR mutability mobility ptrclass inner
+static inline GCPtrGenType::Ownership decodeOwnership(const unsigned own) {
+  switch(own) {
+  default:
+    fprintf(stderr, "Bad ownership code %d\n", own);
+    abort();
+  case PTR_OWN_SHARED: return GCPtrGenType::Shared;
+  case PTR_OWN_UNIQUE: return GCPtrGenType::Unique;
+  }
+}
+
+static inline llvm::Function* getMDFuncArg(const llvm::MDNode* const md,
+                                           const unsigned idx) {
+  if(idx < md->getNumOperands())
+    return llvm::cast<llvm::Function>
+      (llvm::cast<llvm::ValueAsMetadata>(md->getOperand(idx))->getValue());
+  else
+    return NULL;
+}
+
+// Format: GEN_TYPE_GCPTR mobility ptrclass inner
+//         [ownership [accessor [modifier]]]
 const GCPtrGenType* GCPtrGenType::get(const llvm::Module& M,
                                       const llvm::MDNode* const md,
                                       const Mutability mut) {
@@ -208,8 +303,13 @@ const GCPtrGenType* GCPtrGenType::get(const llvm::Module& M,
   const llvm::MDString* const inner =
     llvm::cast<llvm::MDString>(md->getOperand(3));
   llvm::Type* const innerty = getType(M, inner);
+  const Ownership ownership = 4 < md->getNumOperands() ?
+    decodeOwnership(getMDIntArg(md, 4)) : Shared;
+  llvm::Function* const accessFunc = getMDFuncArg(md, 5);
+  llvm::Function* const modifyFunc = getMDFuncArg(md, 6);
 
-  return new GCPtrGenType(innerty, mut, mobility, ptrclass);
+  return new GCPtrGenType(innerty, mut, mobility, ptrclass, ownership,
+                          accessFunc, modifyFunc);
 }
 
 // Format: GC_MD_INT size
@@ -354,3 +454,9 @@ const char* const GCPtrGenType::mobilityStrs[] =
 
 const char* const GCPtrGenType::ptrClassStrs[] =
   { "strong", "soft", "weak", "phantom", "final" };
+
+const char* const GCPtrGenType::ownershipStrs[] =
+  { "shared", "unique" };
+
+const char* const ArrayGenType::layoutStrs[] =
+  { "aos", "soa" };
@@ -42,7 +42,12 @@ bool GenTypePrintVisitor::begin(const ArrayGenType* const ty,
   if(!first)
     stream << ", ";
 
-  stream << ty->mutabilityName() << " " << "[ ";
+  stream << ty->mutabilityName() << " ";
+
+  if(ArrayGenType::SoA == ty->getLayout())
+    stream << ty->getLayoutName() << " ";
+
+  stream << "[ ";
   stream.flush();
   return true;
 }
@@ -119,8 +124,8 @@ void GenTypePrintVisitor::visit(const GCPtrGenType* const ty,
   first = false;
   stream  << ty->mutabilityName() << " ";
   ty->getElemTy()->print(stream);
-  stream << " " << ty->getMobilityName() << " gc " <<
-    ty->getPtrClassName() << "*";
+  stream << " " << ty->getMobilityName() << " " <<
+    ty->getOwnershipName() << " gc " << ty->getPtrClassName() << "*";
   stream.flush();
 }
 
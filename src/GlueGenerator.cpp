@@ -0,0 +1,216 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <algorithm>
+#include <vector>
+#include "GlueGenerator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/GlobalVariable.h"
+
+llvm::StructType* GlueGenerator::getDescType() {
+  llvm::StructType* type = M.getTypeByName("core.gc.typedesc");
+
+  if(NULL == type) {
+    llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(M.getContext());
+    llvm::Type* const fields[9] = {
+      int64ty, int64ty, copies.getCopyFuncType()->getPointerTo(),
+      traces.getTraceFuncType()->getPointerTo(), int64ty,
+      copies.getClusterFuncType()->getPointerTo(),
+      traces.getClusterFuncType()->getPointerTo(),
+      syncs.getSyncFuncType()->getPointerTo(),
+      moves.getMoveFuncType()->getPointerTo()
+    };
+
+    type = llvm::StructType::create(M.getContext(), fields,
+                                    "core.gc.typedesc");
+  }
+
+  return type;
+}
+
+// For variable-sized objects, walk down the last fields of the
+// realization to find the trailing array.
+llvm::Constant* GlueGenerator::descriptor(const GenType* const ty,
+                                          llvm::StructType* const realty,
+                                          llvm::Function* const copyfn,
+                                          llvm::Function* const tracefn,
+                                          llvm::Function* const copyclusterfn,
+                                          llvm::Function* const traceclusterfn,
+                                          llvm::Function* const syncfn,
+                                          llvm::Function* const movefn) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::PointerType* const funcptrty =
+    copies.getCopyFuncType()->getPointerTo();
+  llvm::PointerType* const traceptrty =
+    traces.getTraceFuncType()->getPointerTo();
+  llvm::PointerType* const copyclusterptrty =
+    copies.getClusterFuncType()->getPointerTo();
+  llvm::PointerType* const traceclusterptrty =
+    traces.getClusterFuncType()->getPointerTo();
+  llvm::PointerType* const syncptrty = syncs.getSyncFuncType()->getPointerTo();
+  llvm::PointerType* const moveptrty = moves.getMoveFuncType()->getPointerTo();
+  const ArrayGenType* const cluster =
+    params.clusterize ? CopyGCTraceGen::clusterArray(ty) : NULL;
+  llvm::Constant* fields[9];
+
+  if(ty->isVariableSized()) {
+    const unsigned body = TypeRealizer::bodyIndex(ty);
+    llvm::SmallVector<llvm::Constant*, 8> idxs;
+    llvm::Type* curr = realty->getElementType(body);
+
+    idxs.push_back(llvm::ConstantInt::get(int32ty, 0, false));
+    idxs.push_back(llvm::ConstantInt::get(int32ty, body, false));
+
+    while(llvm::StructType* const structty =
+          llvm::dyn_cast<llvm::StructType>(curr)) {
+      const unsigned last = structty->getNumElements() - 1;
+
+      idxs.push_back(llvm::ConstantInt::get(int32ty, last, false));
+      curr = structty->getElementType(last);
+    }
+
+    idxs.push_back(llvm::ConstantInt::get(int64ty, 0, false));
+
+    llvm::Constant* const null =
+      llvm::ConstantPointerNull::get(realty->getPointerTo());
+    llvm::Constant* const start =
+      llvm::ConstantExpr::getGetElementPtr(realty, null, idxs);
+
+    fields[sizeIndex] = llvm::ConstantExpr::getPtrToInt(start, int64ty);
+    fields[elemSizeIndex] =
+      llvm::ConstantExpr::getSizeOf(curr->getArrayElementType());
+  }
+  else {
+    fields[sizeIndex] = llvm::ConstantExpr::getSizeOf(realty);
+    fields[elemSizeIndex] = llvm::ConstantInt::get(int64ty, 0, false);
+  }
+
+  if(NULL != copyfn)
+    fields[copyIndex] = llvm::ConstantExpr::getPointerCast(copyfn, funcptrty);
+  else
+    fields[copyIndex] = llvm::ConstantPointerNull::get(funcptrty);
+
+  if(NULL != tracefn)
+    fields[traceIndex] =
+      llvm::ConstantExpr::getPointerCast(tracefn, traceptrty);
+  else
+    fields[traceIndex] = llvm::ConstantPointerNull::get(traceptrty);
+
+  if(NULL != cluster && cluster->isSized())
+    fields[clusterLenIndex] =
+      llvm::ConstantInt::get(int64ty, cluster->getNumElems(), false);
+  else
+    fields[clusterLenIndex] = llvm::ConstantInt::get(int64ty, 0, false);
+
+  if(NULL != copyclusterfn)
+    fields[copyClusterIndex] =
+      llvm::ConstantExpr::getPointerCast(copyclusterfn, copyclusterptrty);
+  else
+    fields[copyClusterIndex] =
+      llvm::ConstantPointerNull::get(copyclusterptrty);
+
+  if(NULL != traceclusterfn)
+    fields[traceClusterIndex] =
+      llvm::ConstantExpr::getPointerCast(traceclusterfn, traceclusterptrty);
+  else
+    fields[traceClusterIndex] =
+      llvm::ConstantPointerNull::get(traceclusterptrty);
+
+  if(NULL != syncfn)
+    fields[syncIndex] = llvm::ConstantExpr::getPointerCast(syncfn, syncptrty);
+  else
+    fields[syncIndex] = llvm::ConstantPointerNull::get(syncptrty);
+
+  if(NULL != movefn)
+    fields[moveIndex] = llvm::ConstantExpr::getPointerCast(movefn, moveptrty);
+  else
+    fields[moveIndex] = llvm::ConstantPointerNull::get(moveptrty);
+
+  return llvm::ConstantStruct::get(getDescType(), fields);
+}
+
+void GlueGenerator::generate() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  std::vector<std::string> names;
+
+  for(llvm::StringMap<const GenType*>::const_iterator it = types.begin();
+      it != types.end(); it++)
+    names.push_back(it->getKey().str());
+
+  // Sort the names, so descriptor indexes don't depend on the order
+  // of the metadata.
+  std::sort(names.begin(), names.end());
+
+  const unsigned ntypes = names.size();
+  llvm::ArrayType* const tablety =
+    llvm::ArrayType::get(getDescType(), ntypes);
+  llvm::GlobalVariable* const table =
+    new llvm::GlobalVariable(M, tablety, true,
+                             llvm::GlobalValue::ExternalLinkage,
+                             NULL, "core.gc.typedescs");
+  std::vector<llvm::Constant*> descs(ntypes);
+
+  for(unsigned i = 0; i < ntypes; i++)
+    descidxs[names[i]] = i;
+
+  copies.setDescTable(table, &descidxs);
+
+  // Realize everything before generating any code, as inlined fields
+  // need the realizations of the types they inline.
+  for(unsigned i = 0; i < ntypes; i++)
+    realizer.realize(types.lookup(names[i]), names[i]);
+
+  for(unsigned i = 0; i < ntypes; i++) {
+    const GenType* const ty = types.lookup(names[i]);
+    llvm::StructType* const realty = M.getTypeByName(names[i]);
+    llvm::Constant* const idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, i, false)
+    };
+    llvm::Constant* const desc =
+      llvm::ConstantExpr::getInBoundsGetElementPtr(tablety, table, idxs);
+    llvm::Function* const copyfn =
+      params.copyFuncs ? copies.generate(ty, realty) : NULL;
+    llvm::Function* const tracefn =
+      params.traceFuncs ? traces.generate(ty, realty) : NULL;
+    llvm::Function* const copyclusterfn =
+      params.copyFuncs ? copies.generateCluster(ty, realty) : NULL;
+    llvm::Function* const traceclusterfn =
+      params.traceFuncs ? traces.generateCluster(ty, realty) : NULL;
+    llvm::Function* const syncfn =
+      params.writeLogging ? syncs.generate(ty, realty) : NULL;
+    llvm::Function* const movefn =
+      params.moveFuncs ? moves.generate(ty, realty) : NULL;
+
+    allocs.generate(ty, realty, i, desc);
+    accessors.generate(ty, realty);
+    descs[i] = descriptor(ty, realty, copyfn, tracefn,
+                          copyclusterfn, traceclusterfn, syncfn,
+                          movefn);
+  }
+
+  table->setInitializer(llvm::ConstantArray::get(tablety, descs));
+
+  if(params.writeLogging)
+    syncs.generateCompact();
+}
@@ -0,0 +1,127 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "LeafEnumerator.h"
+#include "TypeRealizer.h"
+
+static GenType::Mutability combine(const GenType::Mutability outer,
+                                   const unsigned inner) {
+  if(GenType::Immutable == outer || GenType::Immutable == inner)
+    return GenType::Immutable;
+  else if(GenType::WriteOnce == outer || GenType::WriteOnce == inner)
+    return GenType::WriteOnce;
+  else
+    return GenType::Mutable;
+}
+
+// This has to follow the same layout decisions as TypeRealizer.
+void LeafEnumerator::enumerate(const GenType* const ty,
+                               llvm::SmallVectorImpl<LeafStep>& path,
+                               const GenType::Mutability outer,
+                               std::vector<Leaf>& out) const {
+  const GenType::Mutability mut = combine(outer, ty->mutability());
+
+  switch(ty->getTypeID()) {
+  default: {
+    Leaf leaf;
+
+    leaf.ty = ty;
+    leaf.mutability = mut;
+    leaf.path.append(path.begin(), path.end());
+    out.push_back(leaf);
+    break;
+  }
+  case GenType::StructTypeID: {
+    const StructGenType* const structty = StructGenType::narrow(ty);
+
+    for(unsigned i = 0; i < structty->numFields(); i++) {
+      const LeafStep step = { false, i };
+
+      path.push_back(step);
+      enumerate(structty->fieldTy(i), path, mut, out);
+      path.pop_back();
+    }
+
+    break;
+  }
+  case GenType::ArrayTypeID: {
+    const ArrayGenType* const arrty = ArrayGenType::narrow(ty);
+    const LeafStep arrstep = { true, arrty->getNumElems() };
+
+    // Structure-of-arrays arrays are a structure of columns.
+    if(ArrayGenType::SoA == arrty->getLayout()) {
+      const StructGenType* const elemty =
+        StructGenType::narrow(arrty->getElemTy());
+
+      for(unsigned i = 0; i < elemty->numFields(); i++) {
+        const LeafStep colstep = { false, i };
+
+        path.push_back(colstep);
+        path.push_back(arrstep);
+        enumerate(elemty->fieldTy(i), path,
+                  combine(mut, elemty->mutability()), out);
+        path.pop_back();
+        path.pop_back();
+      }
+    }
+    else {
+      path.push_back(arrstep);
+      enumerate(arrty->getElemTy(), path, mut, out);
+      path.pop_back();
+    }
+
+    break;
+  }
+  case GenType::GCPtrTypeID: {
+    const GenType* const inlined = NULL != inliner ?
+      inliner->getInlined(GCPtrGenType::narrow(ty)) : NULL;
+
+    // The pointer's mutability says nothing about the pointee's.
+    if(NULL != inlined) {
+      const LeafStep step = { false, TypeRealizer::bodyIndex(inlined) };
+
+      path.push_back(step);
+      enumerate(inlined, path, GenType::Mutable, out);
+      path.pop_back();
+    }
+    else {
+      Leaf leaf;
+
+      leaf.ty = ty;
+      leaf.mutability = mut;
+      leaf.path.append(path.begin(), path.end());
+      out.push_back(leaf);
+    }
+
+    break;
+  }
+  }
+}
+
+void LeafEnumerator::enumerate(const GenType* const ty,
+                               std::vector<Leaf>& out) const {
+  llvm::SmallVector<LeafStep, 8> path;
+  const LeafStep objstep = { false, 0 };
+  const LeafStep bodystep = { false, TypeRealizer::bodyIndex(ty) };
+
+  path.push_back(objstep);
+  path.push_back(bodystep);
+  enumerate(ty, path, GenType::Mutable, out);
+}
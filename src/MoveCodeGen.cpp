@@ -0,0 +1,185 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "AllocGenerator.h"
+#include "TraceGenerator.h"
+#include "TypeRealizer.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+
+llvm::FunctionType* MoveCodeGen::getMoveFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[3] = { int8ptrty, int8ptrty, int8ptrty };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+// The size has to be worked out before the move, since the length
+// word may be overwritten by it.  After the move, the pointers are
+// fixed up in the object's new home, so the traversal reads and
+// writes dst.
+llvm::Function* MoveCodeGen::generate(const GenType* const ty,
+                                      llvm::StructType* const realty) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  const std::string name = realty->getName().str() + ".move";
+  llvm::Function* const F =
+    llvm::Function::Create(getMoveFuncType(),
+                           llvm::GlobalValue::ExternalLinkage, name, &M);
+  llvm::Function::arg_iterator args = F->arg_begin();
+
+  BB = llvm::BasicBlock::Create(C, "", F);
+  gcctx = &*args++;
+
+  llvm::Value* const rawsrc = &*args++;
+  llvm::Value* const rawdst = &*args;
+  llvm::Value* const src =
+    llvm::CastInst::CreatePointerCast(rawsrc, realty->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const dst =
+    llvm::CastInst::CreatePointerCast(rawdst, realty->getPointerTo(),
+                                      "", BB);
+  llvm::Value* len = NULL;
+
+  if(ty->isVariableSized()) {
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, TypeRealizer::lengthIndex(), false)
+    };
+
+    llvm::Value* const lenaddr =
+      llvm::GetElementPtrInst::CreateInBounds(src, idxs, "", BB);
+
+    len = new llvm::LoadInst(lenaddr, "", BB);
+  }
+
+  llvm::Type* const tys[3] = { int8ptrty, int8ptrty, int64ty };
+  llvm::Value* const moveargs[5] = {
+    rawdst, rawsrc, AllocGenerator::objSize(ty, realty, len, BB),
+    llvm::ConstantInt::get(int32ty,
+                           M.getDataLayout().getABITypeAlignment(realty),
+                           false),
+    llvm::ConstantInt::getFalse(C)
+  };
+
+  llvm::CallInst::Create(llvm::Intrinsic::getDeclaration(
+                           &M, llvm::Intrinsic::memmove, tys),
+                         moveargs, "", BB);
+
+  if(ty->hasGCPtrs())
+    traverse(ty, dst, dst);
+
+  llvm::ReturnInst::Create(C, BB);
+  gcctx = NULL;
+  BB = NULL;
+
+  return F;
+}
+
+bool MoveCodeGen::descend(const StructGenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+bool MoveCodeGen::descend(const ArrayGenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+bool MoveCodeGen::descendColumn(const GenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+void MoveCodeGen::visit(const NativePtrGenType*,
+                        llvm::Value*,
+                        llvm::Value*) {}
+
+// Every non-null GC pointer gets relocated, whatever its class, since
+// its referent may have moved either way.  Pointers outside the
+// collected heap, null included, are left alone.  With double
+// pointers, the slot for the current heap is read, and both slots get
+// the new address.
+void MoveCodeGen::visit(const GCPtrGenType*,
+                        llvm::Value* const src,
+                        llvm::Value* const dst) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::Value* slot = src;
+
+  if(params.doublePtrs) {
+    Context context(M, params);
+    llvm::Value* const ctx =
+      llvm::CastInst::CreatePointerCast(gcctx,
+                                        context.getType()->getPointerTo(),
+                                        "", BB);
+
+    slot = context.heapSlotAddr(ctx, src, BB);
+  }
+
+  llvm::Value* const ptr = new llvm::LoadInst(slot, "", BB);
+  llvm::PointerType* const ptrty =
+    llvm::cast<llvm::PointerType>(ptr->getType());
+  llvm::BasicBlock* const relocBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const doneBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Value* const args[2] = {
+    gcctx,
+    llvm::CastInst::CreatePointerCast(ptr, llvm::Type::getInt8PtrTy(C),
+                                      "", relocBB)
+  };
+
+  llvm::BranchInst::Create(relocBB, doneBB, inHeap(ptr, BB), BB);
+
+  llvm::Value* const moved =
+    llvm::CastInst::CreatePointerCast(
+      llvm::CallInst::Create(runtime.getRelocate(), args, "", relocBB),
+      ptrty, "", relocBB);
+
+  if(params.doublePtrs)
+    for(unsigned i = 0; i < 2; i++) {
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, i, false)
+      };
+
+      new llvm::StoreInst(moved,
+                          llvm::GetElementPtrInst::CreateInBounds(dst, idxs,
+                                                                  "",
+                                                                  relocBB),
+                          relocBB);
+    }
+  else
+    new llvm::StoreInst(moved, dst, relocBB);
+
+  llvm::BranchInst::Create(doneBB, relocBB);
+  BB = doneBB;
+}
+
+void MoveCodeGen::visit(const PrimGenType*,
+                        llvm::Value*,
+                        llvm::Value*) {}
+
+void MoveCodeGen::visit(const FuncPtrGenType*,
+                        llvm::Value*,
+                        llvm::Value*) {}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <vector>
+#include "RedundantSafepointPass.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+char RedundantSafepointPass::ID = 0;
+static llvm::RegisterPass<RedundantSafepointPass>
+X("core-redundant-safepoint", "Remove Redundant CORE Safepoints",
+  false, false);
+
+bool RedundantSafepointPass::isSafepoint(const llvm::Instruction* const I,
+                                         const llvm::Function* const
+                                           safepoint) {
+  const llvm::Function* F;
+
+  if(const llvm::CallInst* const call = llvm::dyn_cast<llvm::CallInst>(I))
+    F = call->getCalledFunction();
+  else if(const llvm::InvokeInst* const invoke =
+          llvm::dyn_cast<llvm::InvokeInst>(I))
+    F = invoke->getCalledFunction();
+  else
+    return false;
+
+  return NULL != F && safepoint == F;
+}
+
+// Intrinsics count as ordinary instructions, except for debug info,
+// which generates no code.  Any other call that isn't a safepoint ends
+// the search, even a call to a function using a GC strategy, as it
+// may have no entry poll.
+bool RedundantSafepointPass::redundant(const llvm::CallInst* const call)
+  const {
+  const llvm::Function* const safepoint = call->getCalledFunction();
+  const llvm::BasicBlock* BB = call->getParent();
+  llvm::BasicBlock::const_iterator I(call);
+  llvm::SmallPtrSet<const llvm::BasicBlock*, 8> visited;
+  unsigned count = 0;
+
+  visited.insert(BB);
+
+  while(count < params.safepointBudget) {
+    if(BB->begin() == I) {
+      BB = BB->getSinglePredecessor();
+
+      if(NULL == BB || !visited.insert(BB).second)
+        return false;
+
+      I = BB->end();
+    }
+
+    I--;
+
+    if(isSafepoint(&*I, safepoint))
+      return true;
+    else if((llvm::isa<llvm::CallInst>(&*I) ||
+             llvm::isa<llvm::InvokeInst>(&*I)) &&
+            !llvm::isa<llvm::IntrinsicInst>(&*I))
+      return false;
+
+    if(!llvm::isa<llvm::DbgInfoIntrinsic>(&*I))
+      count++;
+  }
+
+  return false;
+}
+
+// Predecessors come first, so a call is only ever removed on account
+// of one that stays.  Some front ends have the safepoint function
+// hand back the context, in which case the call's result is just its
+// argument.
+bool RedundantSafepointPass::runOnFunction(llvm::Function& F) {
+  const llvm::Function* const safepoint =
+    F.getParent()->getFunction("core.gc.safepoint");
+
+  if(NULL == safepoint || 0 == params.safepointBudget)
+    return false;
+
+  llvm::ReversePostOrderTraversal<llvm::Function*> rpo(&F);
+  std::vector<llvm::CallInst*> calls;
+  bool changed = false;
+
+  for(llvm::ReversePostOrderTraversal<llvm::Function*>::rpo_iterator it =
+        rpo.begin(); it != rpo.end(); it++)
+    for(llvm::BasicBlock::iterator I = (*it)->begin(); I != (*it)->end(); I++)
+      if(llvm::CallInst* const call = llvm::dyn_cast<llvm::CallInst>(I))
+        if(safepoint == call->getCalledFunction())
+          calls.push_back(call);
+
+  for(unsigned i = 0; i < calls.size(); i++)
+    if(redundant(calls[i])) {
+      if(!calls[i]->use_empty()) {
+        if(calls[i]->getType() != calls[i]->getArgOperand(0)->getType())
+          continue;
+
+        calls[i]->replaceAllUsesWith(calls[i]->getArgOperand(0));
+      }
+
+      calls[i]->eraseFromParent();
+      changed = true;
+    }
+
+  return changed;
+}
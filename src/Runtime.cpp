@@ -0,0 +1,158 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "Runtime.h"
+
+llvm::Function* Runtime::getFunc(const char* const name,
+                                 llvm::FunctionType* const functy) {
+  llvm::Function* F = M.getFunction(name);
+
+  if(NULL == F)
+    F = llvm::Function::Create(functy, llvm::GlobalValue::ExternalLinkage,
+                               name, &M);
+
+  return F;
+}
+
+llvm::Function* Runtime::getRawAlloc() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, llvm::Type::getInt64Ty(C) };
+
+  return getFunc("core.gc.rawalloc",
+                 llvm::FunctionType::get(int8ptrty, argtys, false));
+}
+
+llvm::Function* Runtime::getEvacuate() {
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(M.getContext());
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.evacuate",
+                 llvm::FunctionType::get(int8ptrty, argtys, false));
+}
+
+llvm::Function* Runtime::getReserve() {
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(M.getContext());
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.reserve",
+                 llvm::FunctionType::get(int8ptrty, argtys, false));
+}
+
+llvm::Function* Runtime::getEnqueue() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.enqueue",
+                 llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                         argtys, false));
+}
+
+llvm::Function* Runtime::getUnreserve() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.unreserve",
+                 llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                         argtys, false));
+}
+
+llvm::Function* Runtime::getMark() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.mark",
+                 llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                         argtys, false));
+}
+
+llvm::Function* Runtime::getRelocate() {
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(M.getContext());
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.relocate",
+                 llvm::FunctionType::get(int8ptrty, argtys, false));
+}
+
+// This is off the fast path of every write barrier, so tell the
+// optimizer so.
+llvm::Function* Runtime::getLogFull() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const argtys[1] = { llvm::Type::getInt8PtrTy(C) };
+  llvm::Function* const F =
+    getFunc("core.gc.logfull",
+            llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                    argtys, false));
+
+  F->addFnAttr(llvm::Attribute::Cold);
+
+  return F;
+}
+
+llvm::Function* Runtime::getReadBarrier() {
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(M.getContext());
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+  llvm::Function* const F =
+    getFunc("core.gc.readbarrier",
+            llvm::FunctionType::get(int8ptrty, argtys, false));
+
+  F->addFnAttr(llvm::Attribute::Cold);
+
+  return F;
+}
+
+llvm::Function* Runtime::getMarkFull() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const argtys[1] = { llvm::Type::getInt8PtrTy(C) };
+  llvm::Function* const F =
+    getFunc("core.gc.markfull",
+            llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                    argtys, false));
+
+  F->addFnAttr(llvm::Attribute::Cold);
+
+  return F;
+}
+
+llvm::Function* Runtime::getSafepoint() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const argtys[1] = { llvm::Type::getInt8PtrTy(C) };
+  llvm::Function* const F =
+    getFunc("core.gc.safepoint",
+            llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                    argtys, false));
+
+  F->addFnAttr(llvm::Attribute::Cold);
+
+  return F;
+}
+
+llvm::Function* Runtime::getWeakRef() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return getFunc("core.gc.weakref",
+                 llvm::FunctionType::get(llvm::Type::getVoidTy(C),
+                                         argtys, false));
+}
@@ -0,0 +1,158 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <vector>
+#include "SafepointPass.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+
+char SafepointPass::ID = 0;
+static llvm::RegisterPass<SafepointPass> X("core-safepoint",
+                                           "Insert CORE Safepoint Polls",
+                                           false, false);
+
+// The flag load is volatile, so that it can't be hoisted out of the
+// loop it is polling in.
+void SafepointPass::poll(Context& context,
+                         Runtime& runtime,
+                         llvm::BasicBlock* const BB,
+                         llvm::BasicBlock* const contBB) {
+  llvm::Function* const F = BB->getParent();
+  llvm::LLVMContext& C = F->getContext();
+  llvm::BasicBlock* const slowBB =
+    llvm::BasicBlock::Create(C, "", F, contBB);
+  llvm::Value* const ctx =
+    new llvm::LoadInst(context.getCurrent(), "", BB);
+  llvm::Value* const flagaddr =
+    context.fieldAddr(ctx, context.pollIndex(), BB);
+  llvm::Value* const flag = new llvm::LoadInst(flagaddr, "", true, BB);
+  llvm::Value* const stop =
+    new llvm::ICmpInst(*BB, llvm::ICmpInst::ICMP_NE, flag,
+                       llvm::ConstantInt::get(flag->getType(), 0, false));
+  llvm::BranchInst* const br =
+    llvm::BranchInst::Create(slowBB, contBB, stop, BB);
+
+  br->setMetadata(llvm::LLVMContext::MD_prof,
+                  llvm::MDBuilder(C).createBranchWeights(1, 1000));
+
+  llvm::Value* const rawctx =
+    llvm::CastInst::CreatePointerCast(ctx, llvm::Type::getInt8PtrTy(C),
+                                      "", slowBB);
+
+  llvm::CallInst::Create(runtime.getSafepoint(), rawctx, "", slowBB);
+  llvm::BranchInst::Create(contBB, slowBB);
+}
+
+void SafepointPass::pollBefore(Context& context,
+                               Runtime& runtime,
+                               llvm::Instruction* const I,
+                               llvm::Value* const iv) {
+  llvm::BasicBlock* const headBB = I->getParent();
+  llvm::Function* const F = headBB->getParent();
+  llvm::LLVMContext& C = F->getContext();
+  llvm::BasicBlock* const restBB = headBB->splitBasicBlock(I);
+
+  headBB->getTerminator()->eraseFromParent();
+
+  if(NULL == iv)
+    poll(context, runtime, headBB, restBB);
+  else {
+    llvm::BasicBlock* const pollBB =
+      llvm::BasicBlock::Create(C, "", F, restBB);
+    llvm::Value* const mask =
+      llvm::ConstantInt::get(iv->getType(), params.pollStride - 1, false);
+    llvm::Value* const rem =
+      llvm::BinaryOperator::CreateAnd(iv, mask, "", headBB);
+    llvm::Value* const due =
+      new llvm::ICmpInst(*headBB, llvm::ICmpInst::ICMP_EQ, rem,
+                         llvm::ConstantInt::get(iv->getType(), 0, false));
+    llvm::BranchInst* const br =
+      llvm::BranchInst::Create(pollBB, restBB, due, headBB);
+
+    br->setMetadata(llvm::LLVMContext::MD_prof,
+                    llvm::MDBuilder(C).createBranchWeights(1,
+                                                           params.pollStride
+                                                           - 1));
+    poll(context, runtime, pollBB, restBB);
+  }
+}
+
+// Polling at the end of each latch covers every back edge.
+void SafepointPass::pollLoop(Context& context,
+                             Runtime& runtime,
+                             llvm::Loop* const L) {
+  llvm::SmallVector<llvm::BasicBlock*, 4> latches;
+  llvm::Value* const iv =
+    1 < params.pollStride ? L->getCanonicalInductionVariable() : NULL;
+
+  L->getLoopLatches(latches);
+
+  for(unsigned i = 0; i < latches.size(); i++)
+    pollBefore(context, runtime, latches[i]->getTerminator(), iv);
+}
+
+// Intrinsics don't count as calls, as none of them can run for long
+// or reach a safepoint.
+bool SafepointPass::isLeaf(llvm::Function& F) {
+  for(llvm::Function::iterator BB = F.begin(); BB != F.end(); BB++)
+    for(llvm::BasicBlock::iterator I = BB->begin(); I != BB->end(); I++)
+      if((llvm::isa<llvm::CallInst>(I) || llvm::isa<llvm::InvokeInst>(I)) &&
+         !llvm::isa<llvm::IntrinsicInst>(I))
+        return false;
+
+  return true;
+}
+
+void SafepointPass::getAnalysisUsage(llvm::AnalysisUsage& AU) const {
+  AU.addRequired<llvm::LoopInfoWrapperPass>();
+}
+
+// Collect the loops first, since polling splits blocks.
+bool SafepointPass::runOnFunction(llvm::Function& F) {
+  if(F.isDeclaration() || !F.hasGC())
+    return false;
+
+  llvm::Module& M = *F.getParent();
+  llvm::LoopInfo& LI = getAnalysis<llvm::LoopInfoWrapperPass>().getLoopInfo();
+  Context context(M, params);
+  Runtime runtime(M);
+  std::vector<llvm::Loop*> loops(LI.begin(), LI.end());
+  llvm::BasicBlock::iterator entry = F.getEntryBlock().begin();
+
+  if(loops.empty() && isLeaf(F))
+    return false;
+
+  for(unsigned i = 0; i < loops.size(); i++)
+    loops.insert(loops.end(), loops[i]->begin(), loops[i]->end());
+
+  for(unsigned i = 0; i < loops.size(); i++)
+    pollLoop(context, runtime, loops[i]);
+
+  while(llvm::isa<llvm::AllocaInst>(entry))
+    entry++;
+
+  pollBefore(context, runtime, &*entry, NULL);
+
+  return true;
+}
@@ -0,0 +1,462 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <stdio.h>
+#include <stdlib.h>
+#include "TraceGenerator.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+
+llvm::FunctionType* SyncCodeGen::getSyncFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[5] = {
+    int8ptrty, int8ptrty, int8ptrty,
+    context.getLogEntryType()->getPointerTo(),
+    llvm::Type::getInt64Ty(C)
+  };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+// The element number is decoded from the innermost array outward.
+// The outermost array gets whatever is left, which also covers
+// unsized arrays, since they can only be outermost.
+void SyncCodeGen::leafCase(const Leaf& leaf,
+                           llvm::Value* const src,
+                           llvm::Value* const dst,
+                           llvm::Value* const elem,
+                           llvm::SwitchInst* const sw,
+                           const unsigned num) {
+  const GenType* const ty = leaf.ty;
+  const llvm::SmallVectorImpl<LeafStep>& path = leaf.path;
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::BasicBlock* const caseBB =
+    llvm::BasicBlock::Create(C, "", sw->getParent()->getParent());
+  llvm::SmallVector<llvm::Value*, 8> idxs(path.size());
+  llvm::Value* rem = elem;
+  unsigned narrays = 0;
+
+  sw->addCase(llvm::ConstantInt::get(int32ty, num, false), caseBB);
+  BB = caseBB;
+
+  for(unsigned i = 0; i < path.size(); i++)
+    if(path[i].array)
+      narrays++;
+
+  for(unsigned i = path.size(); i > 0; i--) {
+    const LeafStep& step = path[i - 1];
+
+    if(!step.array)
+      idxs[i - 1] = llvm::ConstantInt::get(int32ty, step.idx, false);
+    else if(0 == --narrays)
+      idxs[i - 1] = rem;
+    else {
+      llvm::Value* const n = llvm::ConstantInt::get(int64ty, step.idx, false);
+
+      idxs[i - 1] = llvm::BinaryOperator::CreateURem(rem, n, "", BB);
+      rem = llvm::BinaryOperator::CreateUDiv(rem, n, "", BB);
+    }
+  }
+
+  llvm::Value* const srcaddr =
+    llvm::GetElementPtrInst::CreateInBounds(src, idxs, "", BB);
+  llvm::Value* const dstaddr =
+    llvm::GetElementPtrInst::CreateInBounds(dst, idxs, "", BB);
+
+  switch(ty->getTypeID()) {
+  default:
+    fprintf(stderr, "Unexpected leaf type in sync code generation\n");
+    abort();
+  case GenType::PrimTypeID:
+    visit(PrimGenType::narrow(ty), srcaddr, dstaddr);
+    break;
+  case GenType::NativePtrTypeID:
+    visit(NativePtrGenType::narrow(ty), srcaddr, dstaddr);
+    break;
+  case GenType::GCPtrTypeID:
+    visit(GCPtrGenType::narrow(ty), srcaddr, dstaddr);
+    break;
+  case GenType::FuncPtrTypeID:
+    visit(FuncPtrGenType::narrow(ty), srcaddr, dstaddr);
+    break;
+  }
+
+  llvm::BranchInst::Create(sw->getDefaultDest(), BB);
+}
+
+// Loop over the log entries, and switch on the leaf number.  Unknown
+// leaf numbers are ignored.
+llvm::Function* SyncCodeGen::generate(const GenType* const ty,
+                                      llvm::StructType* const realty) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  const std::string name = realty->getName().str() + ".sync";
+  llvm::Function* const F =
+    llvm::Function::Create(getSyncFuncType(),
+                           llvm::GlobalValue::ExternalLinkage, name, &M);
+  llvm::Function::arg_iterator args = F->arg_begin();
+
+  BB = llvm::BasicBlock::Create(C, "", F);
+  gcctx = &*args++;
+
+  llvm::Value* const src =
+    llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const dst =
+    llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const log = &*args++;
+  llvm::Value* const n = &*args;
+  llvm::BasicBlock* exitBB;
+  llvm::PHINode* const entry =
+    beginLoop(llvm::ConstantInt::get(int64ty, 0, false), n, exitBB);
+  llvm::Value* leafidxs[2] = {
+    entry, llvm::ConstantInt::get(int32ty, Context::logLeafIndex, false)
+  };
+  llvm::Value* elemidxs[2] = {
+    entry, llvm::ConstantInt::get(int32ty, Context::logElemIndex, false)
+  };
+  llvm::Value* const leaf =
+    new llvm::LoadInst(llvm::GetElementPtrInst::CreateInBounds(log, leafidxs,
+                                                               "", BB),
+                       "", BB);
+  llvm::Value* const elem =
+    new llvm::LoadInst(llvm::GetElementPtrInst::CreateInBounds(log, elemidxs,
+                                                               "", BB),
+                       "", BB);
+  llvm::BasicBlock* const nextBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::SwitchInst* const sw = llvm::SwitchInst::Create(leaf, nextBB, 0, BB);
+  std::vector<Leaf> leafs;
+
+  leaves.enumerate(ty, leafs);
+
+  for(unsigned i = 0; i < leafs.size(); i++)
+    leafCase(leafs[i], src, dst, elem, sw, i);
+  BB = nextBB;
+  endLoop(entry, n, exitBB);
+  llvm::ReturnInst::Create(C, BB);
+  gcctx = NULL;
+  BB = NULL;
+
+  return F;
+}
+
+// Objects are compared by address, as unsigned integers.
+llvm::Function* SyncCodeGen::generateCompare() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::PointerType* const entryptrty =
+    context.getLogEntryType()->getPointerTo();
+  llvm::Type* const argtys[2] = { entryptrty, entryptrty };
+  llvm::FunctionType* const functy =
+    llvm::FunctionType::get(int32ty, argtys, false);
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::InternalLinkage,
+                           "core.gc.logentry.cmp", &M);
+  llvm::BasicBlock* const BB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Function::arg_iterator args = F->arg_begin();
+  llvm::Value* const a = &*args++;
+  llvm::Value* const b = &*args;
+  const unsigned keys[3] = {
+    Context::logObjIndex, Context::logLeafIndex, Context::logElemIndex
+  };
+  llvm::Value* result = llvm::ConstantInt::get(int32ty, 0, false);
+
+  // Build the result from the least significant key up.
+  for(unsigned i = 3; i > 0; i--) {
+    llvm::Value* const idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, keys[i - 1], false)
+    };
+    llvm::Value* const aaddr =
+      llvm::GetElementPtrInst::CreateInBounds(a, idxs, "", BB);
+    llvm::Value* const baddr =
+      llvm::GetElementPtrInst::CreateInBounds(b, idxs, "", BB);
+    llvm::Value* akey = new llvm::LoadInst(aaddr, "", BB);
+    llvm::Value* bkey = new llvm::LoadInst(baddr, "", BB);
+
+    if(akey->getType()->isPointerTy()) {
+      akey = new llvm::PtrToIntInst(akey, int64ty, "", BB);
+      bkey = new llvm::PtrToIntInst(bkey, int64ty, "", BB);
+    }
+
+    llvm::Value* const lt =
+      new llvm::ICmpInst(*BB, llvm::ICmpInst::ICMP_ULT, akey, bkey);
+    llvm::Value* const gt =
+      new llvm::ICmpInst(*BB, llvm::ICmpInst::ICMP_UGT, akey, bkey);
+    llvm::Value* const ifgt =
+      llvm::SelectInst::Create(gt, llvm::ConstantInt::get(int32ty, 1, false),
+                               result, "", BB);
+
+    result =
+      llvm::SelectInst::Create(lt,
+                               llvm::ConstantInt::get(int32ty, -1, true),
+                               ifgt, "", BB);
+  }
+
+  llvm::ReturnInst::Create(C, result, BB);
+  F->addFnAttr(llvm::Attribute::AlwaysInline);
+
+  return F;
+}
+
+// The larger child is swapped up until the root is no smaller than
+// either of its children:
+//
+//   loop:  stop if root has no children
+//   left:  pick the left child, unless there is no right one
+//   right: pick the right child if the left one is smaller
+//   pick:  stop if the root is no smaller than the child
+//   swap:  swap the root and the child, and go on from the child
+llvm::Function* SyncCodeGen::generateSiftDown(llvm::Function* const cmp) {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const argtys[3] = {
+    context.getLogEntryType()->getPointerTo(), int64ty, int64ty
+  };
+  llvm::FunctionType* const functy =
+    llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::InternalLinkage,
+                           "core.gc.logentry.siftdown", &M);
+  llvm::BasicBlock* const entryBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const loopBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const leftBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const rightBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const pickBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const swapBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const exitBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Function::arg_iterator args = F->arg_begin();
+  llvm::Value* const log = &*args++;
+  llvm::Value* const start = &*args++;
+  llvm::Value* const end = &*args;
+  llvm::Value* const zero = llvm::ConstantInt::get(int32ty, 0, false);
+  llvm::Value* const one = llvm::ConstantInt::get(int64ty, 1, false);
+
+  llvm::BranchInst::Create(loopBB, entryBB);
+
+  llvm::PHINode* const root = llvm::PHINode::Create(int64ty, 2, "", loopBB);
+  llvm::Value* const left =
+    llvm::BinaryOperator::CreateNUWAdd(
+      llvm::BinaryOperator::CreateNUWShl(root, one, "", loopBB),
+      one, "", loopBB);
+  llvm::Value* const hasleft =
+    new llvm::ICmpInst(*loopBB, llvm::ICmpInst::ICMP_ULT, left, end);
+
+  llvm::BranchInst::Create(leftBB, exitBB, hasleft, loopBB);
+
+  llvm::Value* const right =
+    llvm::BinaryOperator::CreateNUWAdd(left, one, "", leftBB);
+  llvm::Value* const hasright =
+    new llvm::ICmpInst(*leftBB, llvm::ICmpInst::ICMP_ULT, right, end);
+
+  llvm::BranchInst::Create(rightBB, pickBB, hasright, leftBB);
+
+  llvm::Value* const sides[2] = {
+    llvm::GetElementPtrInst::CreateInBounds(log, left, "", rightBB),
+    llvm::GetElementPtrInst::CreateInBounds(log, right, "", rightBB)
+  };
+  llvm::Value* const sidecmp = llvm::CallInst::Create(cmp, sides, "", rightBB);
+  llvm::Value* const rightbigger =
+    new llvm::ICmpInst(*rightBB, llvm::ICmpInst::ICMP_SLT, sidecmp, zero);
+
+  llvm::BranchInst::Create(pickBB, rightBB);
+
+  llvm::PHINode* const useright =
+    llvm::PHINode::Create(llvm::Type::getInt1Ty(C), 2, "", pickBB);
+
+  useright->addIncoming(llvm::ConstantInt::getFalse(C), leftBB);
+  useright->addIncoming(rightbigger, rightBB);
+
+  llvm::Value* const child =
+    llvm::SelectInst::Create(useright, right, left, "", pickBB);
+  llvm::Value* const rootaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, root, "", pickBB);
+  llvm::Value* const childaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, child, "", pickBB);
+  llvm::Value* const pair[2] = { rootaddr, childaddr };
+  llvm::Value* const rootcmp = llvm::CallInst::Create(cmp, pair, "", pickBB);
+  llvm::Value* const smaller =
+    new llvm::ICmpInst(*pickBB, llvm::ICmpInst::ICMP_SLT, rootcmp, zero);
+
+  llvm::BranchInst::Create(swapBB, exitBB, smaller, pickBB);
+
+  llvm::Value* const rootval = new llvm::LoadInst(rootaddr, "", swapBB);
+  llvm::Value* const childval = new llvm::LoadInst(childaddr, "", swapBB);
+
+  new llvm::StoreInst(childval, rootaddr, swapBB);
+  new llvm::StoreInst(rootval, childaddr, swapBB);
+  llvm::BranchInst::Create(loopBB, swapBB);
+
+  root->addIncoming(start, entryBB);
+  root->addIncoming(child, swapBB);
+  llvm::ReturnInst::Create(C, exitBB);
+
+  return F;
+}
+
+// The entries are heapsorted, which needs no scratch space and no
+// help from the runtime.  The duplicates are then squeezed out in
+// one pass, comparing each entry to the last one kept:
+//
+//   entry: return n if there's nothing to do
+//   heap:  sift down entries n / 2 - 1 through 0, making a heap
+//   pop:   swap the root to the end of the heap, shrink the heap, and
+//          sift down the new root, until one entry is left
+//   loop:  compare entry i to entry out - 1
+//   keep:  copy entry i to entry out, and bump out
+//   next:  move on to entry i + 1, or return out
+llvm::Function* SyncCodeGen::generateCompact() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::StructType* const entryty = context.getLogEntryType();
+  llvm::Type* const argtys[2] = { entryty->getPointerTo(), int64ty };
+  llvm::FunctionType* const functy =
+    llvm::FunctionType::get(int64ty, argtys, false);
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::ExternalLinkage,
+                           "core.gc.compactlog", &M);
+  llvm::Function* const siftdown = generateSiftDown(generateCompare());
+  llvm::BasicBlock* const entryBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const heapBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const popBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const loopBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const keepBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const nextBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const exitBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::Function::arg_iterator args = F->arg_begin();
+  llvm::Value* const log = &*args++;
+  llvm::Value* const n = &*args;
+  llvm::Value* const zero = llvm::ConstantInt::get(int64ty, 0, false);
+  llvm::Value* const one = llvm::ConstantInt::get(int64ty, 1, false);
+  llvm::Value* const few =
+    new llvm::ICmpInst(*entryBB, llvm::ICmpInst::ICMP_ULE, n, one);
+  llvm::Value* const half =
+    llvm::BinaryOperator::CreateLShr(n, one, "", entryBB);
+
+  llvm::BranchInst::Create(exitBB, heapBB, few, entryBB);
+
+  llvm::PHINode* const heapidx = llvm::PHINode::Create(int64ty, 2, "", heapBB);
+  llvm::Value* const sift =
+    llvm::BinaryOperator::CreateSub(heapidx, one, "", heapBB);
+  llvm::Value* const heapargs[3] = { log, sift, n };
+  llvm::Value* const built =
+    new llvm::ICmpInst(*heapBB, llvm::ICmpInst::ICMP_EQ, sift, zero);
+
+  heapidx->addIncoming(half, entryBB);
+  heapidx->addIncoming(sift, heapBB);
+  llvm::CallInst::Create(siftdown, heapargs, "", heapBB);
+  llvm::BranchInst::Create(popBB, heapBB, built, heapBB);
+
+  llvm::PHINode* const heapend = llvm::PHINode::Create(int64ty, 2, "", popBB);
+  llvm::Value* const newend =
+    llvm::BinaryOperator::CreateSub(heapend, one, "", popBB);
+  llvm::Value* const endaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, newend, "", popBB);
+  llvm::Value* const rootval = new llvm::LoadInst(log, "", popBB);
+  llvm::Value* const endval = new llvm::LoadInst(endaddr, "", popBB);
+  llvm::Value* const popargs[3] = { log, zero, newend };
+  llvm::Value* const popping =
+    new llvm::ICmpInst(*popBB, llvm::ICmpInst::ICMP_UGT, newend, one);
+
+  new llvm::StoreInst(endval, log, popBB);
+  new llvm::StoreInst(rootval, endaddr, popBB);
+  llvm::CallInst::Create(siftdown, popargs, "", popBB);
+  heapend->addIncoming(n, heapBB);
+  heapend->addIncoming(newend, popBB);
+  llvm::BranchInst::Create(popBB, loopBB, popping, popBB);
+
+  llvm::PHINode* const idx = llvm::PHINode::Create(int64ty, 2, "", loopBB);
+  llvm::PHINode* const out = llvm::PHINode::Create(int64ty, 2, "", loopBB);
+  llvm::Value* const last =
+    llvm::BinaryOperator::CreateSub(out, one, "", loopBB);
+  llvm::Value* const curaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, idx, "", loopBB);
+  llvm::Value* const lastaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, last, "", loopBB);
+  const unsigned keys[3] = {
+    Context::logObjIndex, Context::logLeafIndex, Context::logElemIndex
+  };
+  llvm::Value* same = NULL;
+
+  for(unsigned i = 0; i < 3; i++) {
+    llvm::Value* const idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, keys[i], false)
+    };
+    llvm::Value* const curkey =
+      new llvm::LoadInst(llvm::GetElementPtrInst::CreateInBounds(curaddr,
+                                                                 idxs, "",
+                                                                 loopBB),
+                         "", loopBB);
+    llvm::Value* const lastkey =
+      new llvm::LoadInst(llvm::GetElementPtrInst::CreateInBounds(lastaddr,
+                                                                 idxs, "",
+                                                                 loopBB),
+                         "", loopBB);
+    llvm::Value* const eq =
+      new llvm::ICmpInst(*loopBB, llvm::ICmpInst::ICMP_EQ, curkey, lastkey);
+
+    same = NULL == same ? eq :
+      llvm::BinaryOperator::CreateAnd(same, eq, "", loopBB);
+  }
+
+  llvm::BranchInst::Create(nextBB, keepBB, same, loopBB);
+
+  llvm::Value* const outaddr =
+    llvm::GetElementPtrInst::CreateInBounds(log, out, "", keepBB);
+  llvm::Value* const kept =
+    llvm::BinaryOperator::CreateAdd(out, one, "", keepBB);
+
+  new llvm::StoreInst(new llvm::LoadInst(curaddr, "", keepBB), outaddr,
+                      keepBB);
+  llvm::BranchInst::Create(nextBB, keepBB);
+
+  llvm::PHINode* const newout = llvm::PHINode::Create(int64ty, 2, "", nextBB);
+  llvm::Value* const newidx =
+    llvm::BinaryOperator::CreateAdd(idx, one, "", nextBB);
+  llvm::Value* const more =
+    new llvm::ICmpInst(*nextBB, llvm::ICmpInst::ICMP_ULT, newidx, n);
+
+  newout->addIncoming(out, loopBB);
+  newout->addIncoming(kept, keepBB);
+  llvm::BranchInst::Create(loopBB, exitBB, more, nextBB);
+
+  idx->addIncoming(one, popBB);
+  idx->addIncoming(newidx, nextBB);
+  out->addIncoming(one, popBB);
+  out->addIncoming(newout, nextBB);
+
+  llvm::PHINode* const result = llvm::PHINode::Create(int64ty, 2, "", exitBB);
+
+  result->addIncoming(n, entryBB);
+  result->addIncoming(newout, nextBB);
+  llvm::ReturnInst::Create(C, result, exitBB);
+
+  return F;
+}
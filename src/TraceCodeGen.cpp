@@ -0,0 +1,182 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "TraceGenerator.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+
+llvm::FunctionType* TraceCodeGen::getTraceFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const argtys[2] = { int8ptrty, int8ptrty };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+llvm::FunctionType* TraceCodeGen::getClusterFuncType() {
+  llvm::LLVMContext& C = M.getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::Type* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const argtys[4] = { int8ptrty, int8ptrty, int64ty, int64ty };
+
+  return llvm::FunctionType::get(llvm::Type::getVoidTy(C), argtys, false);
+}
+
+llvm::Function* TraceCodeGen::getNoTrace() {
+  llvm::Function* F = M.getFunction("core.gc.notrace");
+
+  if(NULL == F) {
+    llvm::LLVMContext& C = M.getContext();
+
+    F = llvm::Function::Create(getTraceFuncType(),
+                               llvm::GlobalValue::ExternalLinkage,
+                               "core.gc.notrace", &M);
+    llvm::ReturnInst::Create(C, llvm::BasicBlock::Create(C, "", F));
+  }
+
+  return F;
+}
+
+llvm::Function* TraceCodeGen::generate(const GenType* const ty,
+                                       llvm::StructType* const realty) {
+  if(!ty->hasGCPtrs())
+    return getNoTrace();
+  else {
+    llvm::LLVMContext& C = M.getContext();
+    const std::string name = realty->getName().str() + ".trace";
+    llvm::Function* const F =
+      llvm::Function::Create(getTraceFuncType(),
+                             llvm::GlobalValue::ExternalLinkage, name, &M);
+    llvm::Function::arg_iterator args = F->arg_begin();
+
+    BB = llvm::BasicBlock::Create(C, "", F);
+    gcctx = &*args++;
+
+    llvm::Value* const obj =
+      llvm::CastInst::CreatePointerCast(&*args, realty->getPointerTo(),
+                                        "", BB);
+
+    // Tracing only reads, so the source and destination are the same.
+    clustered = params.clusterize ? clusterArray(ty) : NULL;
+    traverse(ty, obj, obj);
+    llvm::ReturnInst::Create(C, BB);
+    clustered = NULL;
+    gcctx = NULL;
+    BB = NULL;
+
+    return F;
+  }
+}
+
+llvm::Function* TraceCodeGen::generateCluster(const GenType* const ty,
+                                              llvm::StructType* const realty) {
+  const ArrayGenType* const arrty =
+    params.clusterize ? clusterArray(ty) : NULL;
+
+  if(NULL == arrty || !arrty->hasGCPtrs())
+    return NULL;
+  else {
+    llvm::LLVMContext& C = M.getContext();
+    const std::string name = realty->getName().str() + ".trace.cluster";
+    llvm::Function* const F =
+      llvm::Function::Create(getClusterFuncType(),
+                             llvm::GlobalValue::ExternalLinkage, name, &M);
+    llvm::Function::arg_iterator args = F->arg_begin();
+
+    BB = llvm::BasicBlock::Create(C, "", F);
+    gcctx = &*args++;
+
+    llvm::Value* const obj =
+      llvm::CastInst::CreatePointerCast(&*args++, realty->getPointerTo(),
+                                        "", BB);
+    llvm::Value* const start = &*args++;
+    llvm::Value* const end = &*args;
+
+    traverseRange(ty, obj, obj, start, end);
+    llvm::ReturnInst::Create(C, BB);
+    gcctx = NULL;
+    BB = NULL;
+
+    return F;
+  }
+}
+
+bool TraceCodeGen::descend(const StructGenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+bool TraceCodeGen::descend(const ArrayGenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+bool TraceCodeGen::descendColumn(const GenType* const ty) {
+  return ty->hasGCPtrs();
+}
+
+void TraceCodeGen::visit(const NativePtrGenType*,
+                         llvm::Value*,
+                         llvm::Value*) {}
+
+// Only strong pointers keep their referents alive.  Pointers outside
+// the collected heap, null included, are skipped.  With double
+// pointers, both slots hold the same pointer during tracing, so
+// either will do.
+void TraceCodeGen::visit(const GCPtrGenType* const gcty,
+                         llvm::Value* const src,
+                         llvm::Value*) {
+  if(GCPtrGenType::StrongPtr == gcty->getPtrClass()) {
+    llvm::LLVMContext& C = M.getContext();
+    llvm::Function* const F = BB->getParent();
+    llvm::Value* slot = src;
+
+    if(params.doublePtrs) {
+      llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, 0, false)
+      };
+
+      slot = llvm::GetElementPtrInst::CreateInBounds(src, idxs, "", BB);
+    }
+
+    llvm::Value* const ptr = new llvm::LoadInst(slot, "", BB);
+    llvm::BasicBlock* const markBB = llvm::BasicBlock::Create(C, "", F);
+    llvm::BasicBlock* const doneBB = llvm::BasicBlock::Create(C, "", F);
+    llvm::Value* const args[2] = {
+      gcctx,
+      llvm::CastInst::CreatePointerCast(ptr, llvm::Type::getInt8PtrTy(C),
+                                        "", markBB)
+    };
+
+    llvm::BranchInst::Create(markBB, doneBB, inHeap(ptr, BB), BB);
+    llvm::CallInst::Create(runtime.getMark(), args, "", markBB);
+    llvm::BranchInst::Create(doneBB, markBB);
+    BB = doneBB;
+  }
+}
+
+void TraceCodeGen::visit(const PrimGenType*,
+                         llvm::Value*,
+                         llvm::Value*) {}
+
+void TraceCodeGen::visit(const FuncPtrGenType*,
+                         llvm::Value*,
+                         llvm::Value*) {}
@@ -18,16 +18,20 @@
 
 #define __STDC_LIMIT_MACROS 1
 #define __STDC_CONSTANT_MACROS 1
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "GenType.h"
 #include "TraceGenerator.h"
+#include "TypeRealizer.h"
 
-void getSrcDst(llvm::BasicBlock* const BB,
-	       struct IndexState& ctx,
-	       llvm::Value*& src,
-	       llvm::Value*& dst) {
+void CopyGCTraceGen::getSrcDst(llvm::BasicBlock* const BB,
+                               struct IndexState& ctx,
+                               llvm::Value*& src,
+                               llvm::Value*& dst) {
   if(NULL == ctx.loopidx) {
     llvm::LLVMContext& C = BB->getContext();
     llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
@@ -45,6 +49,110 @@ void getSrcDst(llvm::BasicBlock* const BB,
   }
 }
 
+// The top-level context stands for the object itself, so that the
+// body ends up at the right index.
+void CopyGCTraceGen::traverse(const GenType* const ty,
+                              llvm::Value* const src,
+                              llvm::Value* const dst) {
+  struct IndexState root;
+
+  srcobj = src;
+  root.src = src;
+  root.dst = dst;
+  root.loopidx = NULL;
+  root.idx = TypeRealizer::bodyIndex(ty);
+
+  if(0 != params.prefetchDistance) {
+    llvm::IntegerType* const int32ty =
+      llvm::Type::getInt32Ty(BB->getContext());
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, root.idx, false)
+    };
+
+    prefetch(ty, llvm::GetElementPtrInst::CreateInBounds(src, idxs, "", BB));
+  }
+
+  ty->accept(*this, root);
+}
+
+const ArrayGenType* CopyGCTraceGen::clusterArray(const GenType* const ty) {
+  const GenType* curr = ty;
+
+  while(GenType::StructTypeID == curr->getTypeID()) {
+    const StructGenType* const structty = StructGenType::narrow(curr);
+
+    if(0 == structty->numFields())
+      return NULL;
+
+    curr = structty->fieldTy(structty->numFields() - 1);
+  }
+
+  const ArrayGenType* const arrty = ArrayGenType::narrow(curr);
+
+  if(NULL != arrty && ArrayGenType::AoS == arrty->getLayout() &&
+     (!arrty->isSized() || arrty->getNumElems() >= GCParams::clusterSize))
+    return arrty;
+  else
+    return NULL;
+}
+
+// Follow the last fields down to the clustered array, then loop over
+// the range, with the loop index standing in for the array context.
+void CopyGCTraceGen::traverseRange(const GenType* const ty,
+                                   llvm::Value* const src,
+                                   llvm::Value* const dst,
+                                   llvm::Value* const start,
+                                   llvm::Value* const end) {
+  llvm::IntegerType* const int32ty =
+    llvm::Type::getInt32Ty(BB->getContext());
+  const ArrayGenType* const arrty = clusterArray(ty);
+  llvm::SmallVector<llvm::Value*, 8> idxs;
+  const GenType* curr = ty;
+
+  idxs.push_back(llvm::ConstantInt::get(int32ty, 0, false));
+  idxs.push_back(llvm::ConstantInt::get(int32ty,
+                                        TypeRealizer::bodyIndex(ty), false));
+
+  while(GenType::StructTypeID == curr->getTypeID()) {
+    const StructGenType* const structty = StructGenType::narrow(curr);
+    const unsigned last = structty->numFields() - 1;
+
+    idxs.push_back(llvm::ConstantInt::get(int32ty, last, false));
+    curr = structty->fieldTy(last);
+  }
+
+  llvm::Value* const srcarr =
+    llvm::GetElementPtrInst::CreateInBounds(src, idxs, "", BB);
+  llvm::Value* const dstarr =
+    llvm::GetElementPtrInst::CreateInBounds(dst, idxs, "", BB);
+
+  srcobj = src;
+
+  if(vectorScan(arrty->getElemTy()))
+    scanPointers(GCPtrGenType::narrow(arrty->getElemTy()), srcarr, dstarr,
+                 start, end);
+  else {
+    llvm::BasicBlock* exitBB;
+    llvm::PHINode* const loopidx = beginLoop(start, end, exitBB);
+    llvm::Value* elemidxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      loopidx
+    };
+    struct IndexState elem;
+
+    elem.src = llvm::GetElementPtrInst::CreateInBounds(srcarr, elemidxs,
+                                                       "", BB);
+    elem.dst = llvm::GetElementPtrInst::CreateInBounds(dstarr, elemidxs,
+                                                       "", BB);
+    elem.loopidx = loopidx;
+    elem.idx = 0;
+    prefetchAhead(arrty->getElemTy(), srcarr, loopidx, end);
+    arrty->getElemTy()->accept(*this, elem);
+    endLoop(loopidx, end, exitBB);
+  }
+}
+
 bool CopyGCTraceGen::begin(const StructGenType* const gcty,
                            struct IndexState& ctx,
                            struct IndexState& parent) {
@@ -55,62 +163,486 @@ bool CopyGCTraceGen::begin(const StructGenType* const gcty,
   return descend(gcty);
 }
 
+// Sized arrays have a constant length.  Unsized arrays can only be
+// the trailing array of the object, so the length word says how long
+// they are.
+llvm::Value* CopyGCTraceGen::arrayLength(const ArrayGenType* const gcty) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+
+  if(gcty->isSized())
+    return llvm::ConstantInt::get(int64ty, gcty->getNumElems(), false);
+  else {
+    llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, TypeRealizer::lengthIndex(), false)
+    };
+    llvm::Value* const lenaddr =
+      llvm::GetElementPtrInst::CreateInBounds(srcobj, idxs, "", BB);
+
+    return new llvm::LoadInst(lenaddr, "", BB);
+  }
+}
+
+// Start a loop in a new block, and return the loop index variable.
+// The loop is bottom-tested, so it needs a guard unless it's known to
+// run at least once.
+llvm::PHINode* CopyGCTraceGen::beginLoop(llvm::Value* const start,
+                                         llvm::Value* const len,
+                                         llvm::BasicBlock*& exitBB) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::BasicBlock* const loopBB = llvm::BasicBlock::Create(C, "", F, BB);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::PHINode* const loopidx =
+    llvm::PHINode::Create(int64ty, 2, "", loopBB);
+  llvm::ConstantInt* const conststart =
+    llvm::dyn_cast<llvm::ConstantInt>(start);
+  llvm::ConstantInt* const constlen = llvm::dyn_cast<llvm::ConstantInt>(len);
+
+  // Wire in the incoming start value
+  loopidx->addIncoming(start, BB);
+
+  // Polish off the old block
+  if(NULL != conststart && NULL != constlen &&
+     conststart->getZExtValue() < constlen->getZExtValue()) {
+    exitBB = NULL;
+    llvm::BranchInst::Create(loopBB, BB);
+  }
+  else {
+    llvm::Value* const cond =
+      new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, start, len, "");
+
+    exitBB = llvm::BasicBlock::Create(C, "", F);
+    llvm::BranchInst::Create(loopBB, exitBB, cond, BB);
+  }
+  // Make the loop block the insert block
+  BB = loopBB;
+
+  return loopidx;
+}
+
+// Close off a loop started by beginLoop.  The current block may not
+// be the loop header if the body contained loops of its own, so
+// branch back to the block holding the index variable.
+void CopyGCTraceGen::endLoop(llvm::PHINode* const loopidx,
+                             llvm::Value* const len,
+                             llvm::BasicBlock* const exitBB) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::BasicBlock* const newBB =
+    NULL != exitBB ? exitBB : llvm::BasicBlock::Create(C, "", F, BB);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Value* const constone = llvm::ConstantInt::get(int64ty, 1, false);
+  llvm::Value* const inc =
+    llvm::BinaryOperator::CreateAdd(loopidx, constone, "", BB);
+  llvm::Value* const cond =
+    new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, inc, len, "");
+
+  // Add the incoming value for this block (the incremented variable)
+  loopidx->addIncoming(inc, BB);
+  // Add the end of the loop
+  llvm::BranchInst::Create(loopidx->getParent(), newBB, cond, BB);
+  // Set the new block as the insert point
+  BB = newBB;
+}
+
+// Arrays are left alone, as they get their own prefetches inside
+// their loops.
+void CopyGCTraceGen::prefetch(const GenType* const ty,
+                              llvm::Value* const addr) {
+  if(!ty->hasGCPtrs())
+    return;
+
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+
+  switch(ty->getTypeID()) {
+  default: break;
+  case GenType::StructTypeID: {
+    const StructGenType* const structty = StructGenType::narrow(ty);
+
+    for(unsigned i = 0; i < structty->numFields(); i++) {
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, i, false)
+      };
+
+      prefetch(structty->fieldTy(i),
+               llvm::GetElementPtrInst::CreateInBounds(addr, idxs, "", BB));
+    }
+
+    break;
+  }
+  case GenType::GCPtrTypeID: {
+    const GCPtrGenType* const ptrty = GCPtrGenType::narrow(ty);
+    const GenType* const inlined =
+      NULL != inliner ? inliner->getInlined(ptrty) : NULL;
+
+    if(NULL != inlined) {
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, TypeRealizer::bodyIndex(inlined),
+                               false)
+      };
+
+      prefetch(inlined,
+               llvm::GetElementPtrInst::CreateInBounds(addr, idxs, "", BB));
+    }
+    else if(GCPtrGenType::StrongPtr == ptrty->getPtrClass()) {
+      llvm::Value* slot = addr;
+
+      if(params.doublePtrs) {
+        llvm::Value* idxs[2] = {
+          llvm::ConstantInt::get(int32ty, 0, false),
+          llvm::ConstantInt::get(int32ty, 0, false)
+        };
+
+        slot = llvm::GetElementPtrInst::CreateInBounds(addr, idxs, "", BB);
+      }
+
+      llvm::Value* const ptr = new llvm::LoadInst(slot, "", BB);
+      llvm::Value* const args[4] = {
+        llvm::CastInst::CreatePointerCast(ptr, llvm::Type::getInt8PtrTy(C),
+                                          "", BB),
+        // Read access, high locality, data cache
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, 3, false),
+        llvm::ConstantInt::get(int32ty, 1, false)
+      };
+
+      llvm::CallInst::Create(llvm::Intrinsic::getDeclaration(
+                               &M, llvm::Intrinsic::prefetch),
+                             args, "", BB);
+    }
+
+    break;
+  }
+  }
+}
+
+// Clamp the element index to the current one rather than running off
+// the end of the array.
+void CopyGCTraceGen::prefetchAhead(const GenType* const elemty,
+                                   llvm::Value* const arr,
+                                   llvm::Value* const idx,
+                                   llvm::Value* const len) {
+  if(0 != params.prefetchDistance && elemty->hasGCPtrs()) {
+    llvm::LLVMContext& C = BB->getContext();
+    llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+    llvm::Value* const dist =
+      llvm::ConstantInt::get(int64ty, params.prefetchDistance, false);
+    llvm::Value* const ahead =
+      llvm::BinaryOperator::CreateAdd(idx, dist, "", BB);
+    llvm::Value* const inrange =
+      new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, ahead, len, "");
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::SelectInst::Create(inrange, ahead, idx, "", BB)
+    };
+
+    prefetch(elemty,
+             llvm::GetElementPtrInst::CreateInBounds(arr, idxs, "", BB));
+  }
+}
+
+bool CopyGCTraceGen::vectorScan(const GenType* const elemty) {
+  if(GenType::GCPtrTypeID != elemty->getTypeID() || params.doublePtrs)
+    return false;
+  else {
+    const GCPtrGenType* const ptrty = GCPtrGenType::narrow(elemty);
+
+    return GCPtrGenType::StrongPtr == ptrty->getPtrClass() &&
+      (NULL == inliner || NULL == inliner->getInlined(ptrty));
+  }
+}
+
+llvm::Value* CopyGCTraceGen::inHeap(llvm::Value* const ptr,
+                                    llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(BB->getContext());
+  Context context(M, params);
+  llvm::Value* const ctx =
+    llvm::CastInst::CreatePointerCast(gcctx,
+                                      context.getType()->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const start =
+    new llvm::LoadInst(context.fieldAddr(ctx, context.heapStartIndex(), BB),
+                       "", BB);
+  llvm::Value* const end =
+    new llvm::LoadInst(context.fieldAddr(ctx, context.heapEndIndex(), BB),
+                       "", BB);
+  llvm::Value* const addr = new llvm::PtrToIntInst(ptr, int64ty, "", BB);
+
+  return llvm::BinaryOperator::CreateAnd(
+    new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_UGE, addr,
+                       new llvm::PtrToIntInst(start, int64ty, "", BB), ""),
+    new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, addr,
+                       new llvm::PtrToIntInst(end, int64ty, "", BB), ""),
+    "", BB);
+}
+
+// Load one of the heap bounds from the GC context, and splat it
+// across a vector of addresses.
+static llvm::Value* heapBound(Context& context,
+                              llvm::Value* const ctx,
+                              const unsigned idx,
+                              llvm::VectorType* const vecty,
+                              llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(BB->getContext());
+  llvm::Value* const bound =
+    new llvm::PtrToIntInst(new llvm::LoadInst(context.fieldAddr(ctx, idx, BB),
+                                              "", BB),
+                           vecty->getElementType(), "", BB);
+  llvm::Value* const first =
+    llvm::InsertElementInst::Create(llvm::UndefValue::get(vecty), bound,
+                                    llvm::ConstantInt::get(int32ty, 0, false),
+                                    "", BB);
+  llvm::Constant* const mask =
+    llvm::ConstantAggregateZero::get(
+      llvm::VectorType::get(int32ty, vecty->getNumElements()));
+
+  return new llvm::ShuffleVectorInst(first, llvm::UndefValue::get(vecty),
+                                     mask, "", BB);
+}
+
+// The block loop runs over block numbers, with a fixed inner loop over
+// the slots in each block.  Neither the block loop nor the leftover
+// loop need run at all.
+//
+// The heap start is never null, so the bounds check filters out null
+// slots as well.
+void CopyGCTraceGen::scanPointers(const GCPtrGenType* const ptrty,
+                                  llvm::Value* const srcarr,
+                                  llvm::Value* const dstarr,
+                                  llvm::Value* const start,
+                                  llvm::Value* const end) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::Function* const F = BB->getParent();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Type* const slotty =
+    llvm::cast<llvm::PointerType>(srcarr->getType())->getElementType()->
+    getArrayElementType();
+  llvm::VectorType* const vecty = llvm::VectorType::get(slotty, scanWidth);
+  llvm::VectorType* const addrty = llvm::VectorType::get(int64ty, scanWidth);
+  const unsigned align = M.getDataLayout().getABITypeAlignment(slotty);
+  Context context(M, params);
+  llvm::Value* const ctx =
+    llvm::CastInst::CreatePointerCast(gcctx,
+                                      context.getType()->getPointerTo(),
+                                      "", BB);
+  llvm::Value* const heapstart =
+    heapBound(context, ctx, context.heapStartIndex(), addrty, BB);
+  llvm::Value* const heapend =
+    heapBound(context, ctx, context.heapEndIndex(), addrty, BB);
+  llvm::Value* const width = llvm::ConstantInt::get(int64ty, scanWidth, false);
+  llvm::Value* const len =
+    llvm::BinaryOperator::CreateSub(end, start, "", BB);
+  llvm::Value* const nblocks =
+    llvm::BinaryOperator::CreateUDiv(len, width, "", BB);
+  llvm::Value* const blocksend =
+    llvm::BinaryOperator::CreateAdd(start,
+      llvm::BinaryOperator::CreateMul(nblocks, width, "", BB), "", BB);
+
+  // Loop over the blocks, and load each one as a vector
+  llvm::BasicBlock* blockexit;
+  llvm::PHINode* const block =
+    beginLoop(llvm::ConstantInt::get(int64ty, 0, false), nblocks, blockexit);
+  llvm::Value* const base =
+    llvm::BinaryOperator::CreateAdd(start,
+      llvm::BinaryOperator::CreateMul(block, width, "", BB), "", BB);
+  llvm::Value* baseidxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    base
+  };
+  llvm::Value* const srcblock =
+    llvm::CastInst::CreatePointerCast(
+      llvm::GetElementPtrInst::CreateInBounds(srcarr, baseidxs, "", BB),
+      vecty->getPointerTo(), "", BB);
+  llvm::Value* const dstblock =
+    llvm::CastInst::CreatePointerCast(
+      llvm::GetElementPtrInst::CreateInBounds(dstarr, baseidxs, "", BB),
+      vecty->getPointerTo(), "", BB);
+  llvm::LoadInst* const vec = new llvm::LoadInst(srcblock, "", BB);
+
+  vec->setAlignment(align);
+  filteredBlock(vec, dstblock);
+
+  // Skip the block if nothing in it points into the collected heap
+  llvm::Value* const addrs = new llvm::PtrToIntInst(vec, addrty, "", BB);
+  llvm::Value* const inheap =
+    llvm::BinaryOperator::CreateAnd(
+      new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_UGE, addrs, heapstart, ""),
+      new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, addrs, heapend, ""),
+      "", BB);
+  llvm::Value* const mask =
+    new llvm::BitCastInst(inheap, llvm::Type::getIntNTy(C, scanWidth),
+                          "", BB);
+  llvm::Value* const any =
+    new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_NE, mask,
+                       llvm::Constant::getNullValue(mask->getType()), "");
+  llvm::BasicBlock* const slotsBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const nextBB = llvm::BasicBlock::Create(C, "", F);
+
+  llvm::BranchInst::Create(slotsBB, nextBB, any, BB);
+  BB = slotsBB;
+
+  // Visit the slots in the block which point into the heap
+  llvm::BasicBlock* slotexit;
+  llvm::PHINode* const slot =
+    beginLoop(llvm::ConstantInt::get(int64ty, 0, false), width, slotexit);
+  llvm::Value* const live =
+    llvm::ExtractElementInst::Create(inheap, slot, "", BB);
+  llvm::BasicBlock* const visitBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const skipBB = llvm::BasicBlock::Create(C, "", F);
+
+  llvm::BranchInst::Create(visitBB, skipBB, live, BB);
+  BB = visitBB;
+
+  llvm::Value* const idx = llvm::BinaryOperator::CreateAdd(base, slot, "", BB);
+  llvm::Value* slotidxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    idx
+  };
+
+  prefetchAhead(ptrty, srcarr, idx, end);
+  visit(ptrty,
+        llvm::GetElementPtrInst::CreateInBounds(srcarr, slotidxs, "", BB),
+        llvm::GetElementPtrInst::CreateInBounds(dstarr, slotidxs, "", BB));
+  llvm::BranchInst::Create(skipBB, BB);
+  BB = skipBB;
+  endLoop(slot, width, slotexit);
+  llvm::BranchInst::Create(nextBB, BB);
+  BB = nextBB;
+  endLoop(block, nblocks, blockexit);
+
+  // Visit whatever is left over, one slot at a time
+  llvm::BasicBlock* restexit;
+  llvm::PHINode* const rest = beginLoop(blocksend, end, restexit);
+  llvm::Value* restidxs[2] = {
+    llvm::ConstantInt::get(int32ty, 0, false),
+    rest
+  };
+
+  prefetchAhead(ptrty, srcarr, rest, end);
+  visit(ptrty,
+        llvm::GetElementPtrInst::CreateInBounds(srcarr, restidxs, "", BB),
+        llvm::GetElementPtrInst::CreateInBounds(dstarr, restidxs, "", BB));
+  endLoop(rest, end, restexit);
+}
+
+// Structure-of-arrays arrays get one loop for each column that needs
+// to be traversed.  The element structure itself never gets visited.
+void CopyGCTraceGen::columns(const ArrayGenType* const gcty,
+                             struct IndexState& parent) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  const StructGenType* const elemty = StructGenType::narrow(gcty->getElemTy());
+  llvm::Value* const len = arrayLength(gcty);
+  llvm::Value* src;
+  llvm::Value* dst;
+
+  getSrcDst(BB, parent, src, dst);
+
+  for(unsigned i = 0; i < elemty->numFields(); i++) {
+    const GenType* const fieldty = elemty->fieldTy(i);
+
+    if(descendColumn(fieldty)) {
+      llvm::BasicBlock* exitBB;
+      llvm::PHINode* const loopidx =
+        beginLoop(llvm::ConstantInt::get(int64ty, 0, false), len, exitBB);
+      llvm::Value* colidxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        llvm::ConstantInt::get(int32ty, i, false)
+      };
+      llvm::Value* const srccol =
+        llvm::GetElementPtrInst::CreateInBounds(src, colidxs, "", BB);
+      llvm::Value* const dstcol =
+        llvm::GetElementPtrInst::CreateInBounds(dst, colidxs, "", BB);
+      llvm::Value* idxs[2] = {
+        llvm::ConstantInt::get(int32ty, 0, false),
+        loopidx
+      };
+      struct IndexState column;
+
+      column.src =
+        llvm::GetElementPtrInst::CreateInBounds(srccol, idxs, "", BB);
+      column.dst =
+        llvm::GetElementPtrInst::CreateInBounds(dstcol, idxs, "", BB);
+      column.loopidx = loopidx;
+      column.idx = 0;
+      prefetchAhead(fieldty, srccol, loopidx, len);
+      fieldty->accept(*this, column);
+      endLoop(loopidx, len, exitBB);
+    }
+  }
+}
+
 // Create a loop that iterates the elements of the array, and then
-// push the loop index variable.  Note: this assumes arrays are short,
-// or else not being clustered.
+// push the loop index variable.  When clustering, large arrays are
+// skipped here, and traversed in pieces by traverseRange.
 bool CopyGCTraceGen::begin(const ArrayGenType* const gcty,
                            struct IndexState& ctx,
                            struct IndexState& parent) {
-  bool out = descend(gcty);
+  ctx.loopidx = NULL;
 
-  if(out) {
+  // The clustered array is handled by the cluster-range functions.
+  if(gcty == clustered || !descend(gcty)) {
+    // The array still takes up a field.
+    if(NULL == parent.loopidx)
+      parent.idx++;
+
+    return false;
+  }
+  else if(ArrayGenType::SoA == gcty->getLayout()) {
+    columns(gcty, parent);
+
+    return false;
+  }
+  else if(vectorScan(gcty->getElemTy())) {
+    llvm::IntegerType* const int64ty =
+      llvm::Type::getInt64Ty(BB->getContext());
+    llvm::Value* const len = arrayLength(gcty);
+    llvm::Value* srcarr;
+    llvm::Value* dstarr;
+
+    getSrcDst(BB, parent, srcarr, dstarr);
+    scanPointers(GCPtrGenType::narrow(gcty->getElemTy()), srcarr, dstarr,
+                 llvm::ConstantInt::get(int64ty, 0, false), len);
+
+    return false;
+  }
+  else {
     llvm::LLVMContext& C = BB->getContext();
-    llvm::Function* const F = BB->getParent();
-    llvm::BasicBlock* const loopBB = llvm::BasicBlock::Create(C, "", F, BB);
     llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
-    llvm::Value* const constzero = llvm::ConstantInt::get(int64ty, 0, false);
+    llvm::Value* const len = arrayLength(gcty);
     llvm::PHINode* const loopidx =
-      llvm::PHINode::Create(int64ty, 2, "", loopBB);
-
-    // Wire in the incoming zero
-    loopidx->addIncoming(constzero, BB);
-    // Polish off the old block
-    llvm::BranchInst::Create(loopBB, BB);
-    // Make the loop block the insert block
-    BB = loopBB;
+      beginLoop(llvm::ConstantInt::get(int64ty, 0, false), len, ctx.exit);
 
     // Create the new contex
     llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+    llvm::Value* srcarr;
+    llvm::Value* dstarr;
 
-    if(NULL == parent.loopidx) {
-      llvm::Value* idxs[3] = {
-	llvm::ConstantInt::get(int32ty, 0, false),
-	llvm::ConstantInt::get(int32ty, parent.idx++, false),
-	loopidx
-      };
-
-      ctx.src = llvm::GetElementPtrInst::CreateInBounds(parent.src, idxs,
-                                                        "", loopBB);
-      ctx.dst = llvm::GetElementPtrInst::CreateInBounds(parent.dst, idxs,
-                                                        "", loopBB);
-    }
-    else {
-      llvm::Value* idxs[2] = {
-	llvm::ConstantInt::get(int32ty, 0, false),
-	loopidx
-      };
+    getSrcDst(BB, parent, srcarr, dstarr);
 
-      ctx.src = llvm::GetElementPtrInst::CreateInBounds(parent.src, idxs,
-                                                        "", loopBB);
-      ctx.dst = llvm::GetElementPtrInst::CreateInBounds(parent.dst, idxs,
-                                                        "", loopBB);
-    }
+    llvm::Value* idxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      loopidx
+    };
 
+    ctx.src = llvm::GetElementPtrInst::CreateInBounds(srcarr, idxs, "", BB);
+    ctx.dst = llvm::GetElementPtrInst::CreateInBounds(dstarr, idxs, "", BB);
+    prefetchAhead(gcty->getElemTy(), srcarr, loopidx, len);
     ctx.loopidx = loopidx;
+    ctx.len = len;
     ctx.idx = 0;
-  }
 
-  return out;
+    return true;
+  }
 }
 
 bool CopyGCTraceGen::begin(const FuncPtrGenType* const gcty,
@@ -126,31 +658,13 @@ bool CopyGCTraceGen::begin(const FuncPtrGenType* const gcty,
 }
 
 
-void CopyGCTraceGen::end(const ArrayGenType* gcty,
+// Arrays that weren't descended into (including structure-of-arrays
+// arrays, which close their own loops) have no loop to close.
+void CopyGCTraceGen::end(const ArrayGenType*,
                          struct IndexState& ctx,
                          struct IndexState&) {
-  llvm::LLVMContext& C = BB->getContext();
-  llvm::Function* const F = BB->getParent();
-  llvm::BasicBlock* const newBB = llvm::BasicBlock::Create(C, "", F, BB);
-  llvm::PHINode* const loopidx = ctx.loopidx;
-  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
-  llvm::Value* const constone = llvm::ConstantInt::get(int64ty, 1, false);
-  llvm::Value* const inc =
-    llvm::BinaryOperator::CreateAdd(loopidx, constone, "", BB);
-  // Get the array's length
-  // XXX need to make provisions for non-clustered, yet variable
-  // sized arrays.
-  llvm::Value* const len =
-    llvm::ConstantInt::get(int64ty, gcty->getNumElems(), false);
-  llvm::Value* const cond =
-    new llvm::ICmpInst(*BB, llvm::CmpInst::ICMP_ULT, inc, len, "");
-
-  // Add the incoming value for this block (the incremented variable)
-  loopidx->addIncoming(inc, BB);
-  // Add the end of the loop
-  llvm::BranchInst::Create(BB, newBB, cond, BB);
-  // Set the new block as the insert point
-  BB = newBB;
+  if(NULL != ctx.loopidx)
+    endLoop(ctx.loopidx, ctx.len, ctx.exit);
 }
 
 void CopyGCTraceGen::visit(const NativePtrGenType* const gcty,
@@ -162,13 +676,29 @@ void CopyGCTraceGen::visit(const NativePtrGenType* const gcty,
   visit(gcty, src, dst);
 }
 
+// Inlined objects are part of the parent, so traverse their bodies in
+// place, after letting the subclass deal with their headers.
 void CopyGCTraceGen::visit(const GCPtrGenType* const gcty,
                            struct IndexState& ctx) {
+  const GenType* const inlined =
+    NULL != inliner ? inliner->getInlined(gcty) : NULL;
   llvm::Value* src;
   llvm::Value* dst;
 
   getSrcDst(BB, ctx, src, dst);
-  visit(gcty, src, dst);
+
+  if(NULL != inlined) {
+    struct IndexState inner;
+
+    inlinedHeader(gcty, src, dst);
+    inner.src = src;
+    inner.dst = dst;
+    inner.loopidx = NULL;
+    inner.idx = TypeRealizer::bodyIndex(inlined);
+    inlined->accept(*this, inner);
+  }
+  else
+    visit(gcty, src, dst);
 }
 
 void CopyGCTraceGen::visit(const PrimGenType* const gcty,
@@ -190,22 +720,35 @@ bool CopyGCTraceGen::descend(const ArrayGenType* ty) {
   return true;
 }
 
+// Null slots need nothing done unless the subclass says otherwise.
+void CopyGCTraceGen::filteredBlock(llvm::Value*, llvm::Value*) {}
+
+// Headers of inlined objects need nothing done unless the subclass
+// says otherwise.
+void CopyGCTraceGen::inlinedHeader(const GCPtrGenType*, llvm::Value*,
+                                   llvm::Value*) {}
+
+// Columns are traversed unless the subclass says otherwise.
+bool CopyGCTraceGen::descendColumn(const GenType*) {
+  return true;
+}
+
 // XXX dummy implementation for testing
 void CopyGCTraceGen::visit(const NativePtrGenType* gcty,
-                                 const llvm::Value* src,
-                                 const llvm::Value* dst) {}
+                                 llvm::Value* src,
+                                 llvm::Value* dst) {}
 
 // XXX dummy implementation for testing
 void CopyGCTraceGen::visit(const GCPtrGenType* gcty,
-                                 const llvm::Value* src,
-                                 const llvm::Value* dst) {}
+                                 llvm::Value* src,
+                                 llvm::Value* dst) {}
 
 // XXX dummy implementation for testing
 void CopyGCTraceGen::visit(const PrimGenType* gcty,
-                                 const llvm::Value* src,
-                                 const llvm::Value* dst) {}
+                                 llvm::Value* src,
+                                 llvm::Value* dst) {}
 
 // XXX dummy implementation for testing
 void CopyGCTraceGen::visit(const FuncPtrGenType* gcty,
-                                 const llvm::Value* src,
-                                 const llvm::Value* dst) {}
+                                 llvm::Value* src,
+                                 llvm::Value* dst) {}
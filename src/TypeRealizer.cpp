@@ -18,6 +18,8 @@
 
 #define __STDC_LIMIT_MACROS 1
 #define __STDC_CONSTANT_MACROS 1
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "TypeBuilder.h"
 #include "TypeRealizer.h"
@@ -56,12 +58,35 @@ bool TypeRealizer::begin(const FuncPtrGenType* const gcty,
   return true;
 }
 
+// Structure-of-arrays layouts become a structure with one array for
+// each field of the element type.  These are built here, and handed
+// straight to the parent.
 bool TypeRealizer::begin(const ArrayGenType* const gcty,
                          TypeBuilder*& ctx,
-                         TypeBuilder*&) {
-  ctx = new ArrayTypeBuilder(gcty);
+                         TypeBuilder*& parent) {
+  if(ArrayGenType::SoA == gcty->getLayout()) {
+    const StructGenType* const elemty =
+      StructGenType::narrow(gcty->getElemTy());
+    StructTypeBuilder columns(elemty->numFields(), "", false);
 
-  return true;
+    for(unsigned i = 0; i < elemty->numFields(); i++) {
+      TypeBuilder* column = new ArrayTypeBuilder(gcty);
+
+      elemty->fieldTy(i)->accept(*this, column);
+      columns.add(column->build(M));
+      delete column;
+    }
+
+    parent->add(columns.build(M));
+    ctx = NULL;
+
+    return false;
+  }
+  else {
+    ctx = new ArrayTypeBuilder(gcty);
+
+    return true;
+  }
 }
 
 // Both structures and arrays might just be handed down to their
@@ -84,7 +109,9 @@ void TypeRealizer::end(const StructGenType*,
 void TypeRealizer::end(const ArrayGenType*,
                        TypeBuilder*& ctx,
                        TypeBuilder*& parent) {
-  if(NULL != parent) {
+  if(NULL == ctx)
+    return;
+  else if(NULL != parent) {
     llvm::Type* ty = ctx->build(M);
     parent->add(ty);
     delete ctx;
@@ -119,7 +146,11 @@ void TypeRealizer::visit(const GCPtrGenType* const gcty,
   llvm::Type* const ptrty = llvm::PointerType::getUnqual(gcty->getElemTy());
   llvm::Type* llvmty;
 
-  if(params.doublePtrs)
+  // Inlined objects are stored whole, so that the pointee's accessors
+  // can work on the interior address.
+  if(NULL != inliner && NULL != inliner->getInlined(gcty))
+    llvmty = gcty->getElemTy();
+  else if(params.doublePtrs)
     llvmty = llvm::ArrayType::get(ptrty, 2);
   else
     llvmty = ptrty;
@@ -134,9 +165,50 @@ void TypeRealizer::visit(const PrimGenType* const gcty,
   ctx->add(ty);
 }
 
+// Unsized arrays can only appear at the very end of an object, where
+// the length word describes them.
+static void checkTrailing(const GenType* const ty,
+                          const bool trailing) {
+  switch(ty->getTypeID()) {
+  default: break;
+  case GenType::ArrayTypeID: {
+    const ArrayGenType* const arrty = ArrayGenType::narrow(ty);
+
+    if(!arrty->isSized() && !trailing) {
+      fprintf(stderr, "Unsized array is not the last field of an object\n");
+      abort();
+    }
+
+    checkTrailing(arrty->getElemTy(), false);
+    break;
+  }
+  case GenType::StructTypeID: {
+    const StructGenType* const structty = StructGenType::narrow(ty);
+    const unsigned nfields = structty->numFields();
+
+    for(unsigned i = 0; i < nfields; i++)
+      checkTrailing(structty->fieldTy(i), trailing && i == nfields - 1);
+
+    break;
+  }
+  }
+}
+
 const llvm::Type* TypeRealizer::realize(const GenType* const ty,
                                         const llvm::StringRef name) {
-  TypeBuilder* builder = new StructTypeBuilder(1, name, true);
+  const bool varsize = ty->isVariableSized();
+
+  checkTrailing(ty, true);
+
+  // The object is the header, followed by the length for
+  // variable-sized objects, followed by the body.  Don't pack this,
+  // or the body might end up misaligned.
+  TypeBuilder* builder = new StructTypeBuilder(varsize ? 3 : 2, name, false);
+  builder->add(header.getType());
+
+  if(varsize)
+    builder->add(llvm::Type::getInt64Ty(M.getContext()));
+
   ty->accept(*this, builder);
   const llvm::Type* const out = builder->build(M);
   delete builder;
@@ -0,0 +1,727 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include "WriteBarrierPass.h"
+#include "ParseMetadataPass.h"
+#include "FieldInliner.h"
+#include "LeafEnumerator.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
+
+typedef std::vector<const llvm::Value*> LogKey;
+typedef std::set<LogKey> LogKeys;
+
+char WriteBarrierPass::ID = 0;
+static llvm::RegisterPass<WriteBarrierPass> X("core-write-barrier",
+                                              "Insert CORE Write Barriers",
+                                              false, false);
+
+static llvm::Function* accessor(const GenType* const ty) {
+  switch(ty->getTypeID()) {
+  default: return NULL;
+  case GenType::PrimTypeID:
+    return PrimGenType::narrow(ty)->getAccessFunc();
+  case GenType::GCPtrTypeID:
+    return GCPtrGenType::narrow(ty)->getAccessFunc();
+  }
+}
+
+static llvm::Function* modifier(const GenType* const ty) {
+  switch(ty->getTypeID()) {
+  default: return NULL;
+  case GenType::PrimTypeID:
+    return PrimGenType::narrow(ty)->getModifyFunc();
+  case GenType::GCPtrTypeID:
+    return GCPtrGenType::narrow(ty)->getModifyFunc();
+  }
+}
+
+static bool sameField(const LoggedField& a, const LoggedField& b) {
+  if(a.leaf != b.leaf || a.mutability != b.mutability ||
+     a.gcptr != b.gcptr || a.dims != b.dims ||
+     a.path.size() != b.path.size())
+    return false;
+
+  for(unsigned i = 0; i < a.path.size(); i++)
+    if(a.path[i].array != b.path[i].array || a.path[i].idx != b.path[i].idx)
+      return false;
+
+  return true;
+}
+
+// With inlining, the leaves of an inlined object show up in its
+// parent as well, but its modifiers still take the inlined object
+// itself, so they belong to the pointee type.  Look at the leaves
+// without inlining to see which modifiers a type owns.  Writes to an
+// inlined object are logged against its interior address, which the
+// copy of its parent forwards like any other object.
+//
+// A modifier shared between types is only allowed if it writes the
+// same field in each, as a barrier has no way to tell them apart.
+// The realization may differ, as the field's place in it doesn't.
+void WriteBarrierPass::findFields(llvm::Module& M,
+                                  const llvm::StringMap<const GenType*>&
+                                    types) {
+  const FieldInliner inliner(params, types);
+  const LeafEnumerator leaves(&inliner);
+  const LeafEnumerator plain;
+
+  for(llvm::StringMap<const GenType*>::const_iterator it = types.begin();
+      it != types.end(); it++) {
+    const GenType* const ty = it->getValue();
+    const llvm::Function* const alloc =
+      M.getFunction(it->getKey().str() + ".alloc");
+    llvm::SmallPtrSet<const llvm::Function*, 16> owned;
+    std::vector<Leaf> leafs;
+
+    if(NULL != alloc)
+      allocators.insert(alloc);
+
+    plain.enumerate(ty, leafs);
+
+    for(unsigned i = 0; i < leafs.size(); i++) {
+      if(NULL != modifier(leafs[i].ty))
+        owned.insert(modifier(leafs[i].ty));
+
+      if(NULL != accessor(leafs[i].ty))
+        accessors.insert(accessor(leafs[i].ty));
+    }
+
+    leafs.clear();
+    leaves.enumerate(ty, leafs);
+
+    for(unsigned i = 0; i < leafs.size(); i++) {
+      const llvm::Function* const F = modifier(leafs[i].ty);
+
+      if(NULL != F && owned.count(F)) {
+        LoggedField field;
+
+        field.leaf = i;
+        field.mutability = leafs[i].mutability;
+        field.gcptr = GenType::GCPtrTypeID == leafs[i].ty->getTypeID();
+
+        field.realty = M.getTypeByName(it->getKey());
+        field.path = leafs[i].path;
+
+        for(unsigned j = 0; j < leafs[i].path.size(); j++)
+          if(leafs[i].path[j].array)
+            field.dims.push_back(leafs[i].path[j].idx);
+
+        llvm::DenseMap<const llvm::Function*, LoggedField>::const_iterator
+          old = fields.find(F);
+
+        if(fields.end() == old)
+          fields[F] = field;
+        else if(!sameField(old->second, field)) {
+          fprintf(stderr, "Modifier %s writes different fields\n",
+                  F->getName().str().c_str());
+          abort();
+        }
+      }
+    }
+  }
+}
+
+static const llvm::Function* calledFunction(const llvm::Instruction* const I,
+                                            bool& call) {
+  if(const llvm::CallInst* const CI = llvm::dyn_cast<llvm::CallInst>(I)) {
+    call = true;
+    return CI->getCalledFunction();
+  }
+  else if(const llvm::InvokeInst* const II =
+          llvm::dyn_cast<llvm::InvokeInst>(I)) {
+    call = true;
+    return II->getCalledFunction();
+  }
+  else {
+    call = false;
+    return NULL;
+  }
+}
+
+bool WriteBarrierPass::maySafepoint(const llvm::Instruction* const I) const {
+  bool call;
+  const llvm::Function* const F = calledFunction(I, call);
+
+  if(!call)
+    return false;
+  else if(NULL == F)
+    return true;
+  else if(F->isIntrinsic())
+    return llvm::Intrinsic::experimental_gc_statepoint ==
+      F->getIntrinsicID();
+  else
+    return !fields.count(F) && !accessors.count(F);
+}
+
+// The object and the index arguments identify the write, along with
+// the modifier.  Casts of the object don't change it.
+static LogKey logKey(const llvm::CallInst* const call) {
+  LogKey key;
+
+  key.push_back(call->getCalledFunction());
+  key.push_back(call->getArgOperand(0)->stripPointerCasts());
+
+  for(unsigned i = 1; i + 1 < call->getNumArgOperands(); i++)
+    key.push_back(call->getArgOperand(i));
+
+  return key;
+}
+
+// Taking the address of an object, or looking at it through an
+// accessor or modifier, is fine.  Anything else that could let the
+// pointer get somewhere else counts as escaping.
+bool WriteBarrierPass::escapes(const llvm::Instruction* const I,
+                               const unsigned idx) const {
+  if(llvm::isa<llvm::BitCastInst>(I) || llvm::isa<llvm::ICmpInst>(I) ||
+     llvm::isa<llvm::LoadInst>(I))
+    return false;
+  else if(llvm::isa<llvm::StoreInst>(I))
+    return 0 == idx;
+  else if(const llvm::CallInst* const call =
+          llvm::dyn_cast<llvm::CallInst>(I)) {
+    const llvm::Function* const F = call->getCalledFunction();
+
+    return 0 != idx || NULL == F ||
+      (!fields.count(F) && !accessors.count(F));
+  }
+  else
+    return true;
+}
+
+// The collector can't have seen a fresh object yet, so whatever it
+// holds when the collector first does see it is what gets copied.
+// That says nothing about which generation it is in, so this doesn't
+// cover card marks.
+//
+// Being immutable doesn't help on its own.  The initializing write to
+// an immutable field can come after a safepoint at which the object
+// was already copied, and then the copy needs the write as much as
+// any other.
+bool WriteBarrierPass::unneeded(const llvm::CallInst* const call,
+                                const BarrierFacts& facts) const {
+  return facts.fresh.count(call->getArgOperand(0)->stripPointerCasts());
+}
+
+// A value defined in a loop is a different value on each iteration,
+// so any fact involving it that comes around the back edge is
+// forgotten at its definition.
+//
+// Allocation may collect, so it ends the current safepoint interval
+// before it starts a fresh object.
+void WriteBarrierPass::transfer(const llvm::BasicBlock* const BB,
+                                BarrierFacts& facts,
+                                llvm::SmallPtrSetImpl<const llvm::CallInst*>*
+                                  const elided,
+                                llvm::SmallPtrSetImpl<const llvm::CallInst*>*
+                                  const unlogged) const {
+  for(llvm::BasicBlock::const_iterator I = BB->begin(); I != BB->end(); I++) {
+    for(LogKeys::iterator it = facts.logged.begin();
+        it != facts.logged.end();)
+      if(it->end() != std::find(it->begin(), it->end(), &*I))
+        facts.logged.erase(it++);
+      else
+        it++;
+
+    facts.fresh.erase(&*I);
+
+    for(unsigned i = 0; i < I->getNumOperands(); i++)
+      if(facts.fresh.count(I->getOperand(i)->stripPointerCasts()) &&
+         escapes(&*I, i))
+        facts.fresh.erase(I->getOperand(i)->stripPointerCasts());
+
+    const llvm::CallInst* const call = llvm::dyn_cast<llvm::CallInst>(&*I);
+    const llvm::Function* const F =
+      NULL != call ? call->getCalledFunction() : NULL;
+
+    if(NULL != F && fields.count(F)) {
+      const LogKey key = logKey(call);
+
+      if(facts.logged.count(key)) {
+        if(NULL != elided)
+          elided->insert(call);
+      }
+      else if(unneeded(call, facts)) {
+        if(NULL != unlogged)
+          unlogged->insert(call);
+      }
+      else
+        facts.logged.insert(key);
+    }
+    else if(maySafepoint(&*I)) {
+      facts.logged.clear();
+      facts.fresh.clear();
+
+      if(NULL != F && allocators.count(F))
+        facts.fresh.insert(call);
+    }
+  }
+}
+
+template <typename T>
+static void intersect(std::set<T>& a, const std::set<T>& b) {
+  std::set<T> both;
+
+  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                        std::inserter(both, both.begin()));
+  a.swap(both);
+}
+
+// Predecessors that haven't been visited yet are taken to know
+// everything.
+static void meet(const llvm::BasicBlock* const BB,
+                 const std::map<const llvm::BasicBlock*, BarrierFacts>& out,
+                 BarrierFacts& facts) {
+  bool first = true;
+
+  for(llvm::const_pred_iterator pred = llvm::pred_begin(BB);
+      pred != llvm::pred_end(BB); pred++) {
+    std::map<const llvm::BasicBlock*, BarrierFacts>::const_iterator prev =
+      out.find(*pred);
+
+    if(out.end() == prev)
+      continue;
+    else if(first) {
+      facts = prev->second;
+      first = false;
+    }
+    else {
+      intersect(facts.logged, prev->second.logged);
+      intersect(facts.fresh, prev->second.fresh);
+    }
+  }
+}
+
+// This is a must analysis: something is known on entry to a block if
+// it is known on exit from all of its predecessors.  The sets start
+// out optimistic and only shrink from there.
+void WriteBarrierPass::findElided(llvm::Function& F,
+                                  llvm::SmallPtrSetImpl<const
+                                                        llvm::CallInst*>&
+                                    elided,
+                                  llvm::SmallPtrSetImpl<const
+                                                        llvm::CallInst*>&
+                                    unlogged) const {
+  llvm::ReversePostOrderTraversal<llvm::Function*> rpo(&F);
+  std::map<const llvm::BasicBlock*, BarrierFacts> out;
+  bool changed = true;
+
+  while(changed) {
+    changed = false;
+
+    for(llvm::ReversePostOrderTraversal<llvm::Function*>::rpo_iterator it =
+          rpo.begin(); it != rpo.end(); it++) {
+      const llvm::BasicBlock* const BB = *it;
+      BarrierFacts facts;
+
+      meet(BB, out, facts);
+      transfer(BB, facts, NULL, NULL);
+
+      std::map<const llvm::BasicBlock*, BarrierFacts>::iterator old =
+        out.find(BB);
+
+      if(out.end() == old) {
+        out[BB] = facts;
+        changed = true;
+      }
+      else if(old->second.logged != facts.logged ||
+              old->second.fresh != facts.fresh) {
+        old->second = facts;
+        changed = true;
+      }
+    }
+  }
+
+  for(llvm::ReversePostOrderTraversal<llvm::Function*>::rpo_iterator it =
+        rpo.begin(); it != rpo.end(); it++) {
+    const llvm::BasicBlock* const BB = *it;
+    BarrierFacts facts;
+
+    meet(BB, out, facts);
+    transfer(BB, facts, &elided, &unlogged);
+  }
+}
+
+// Flatten the index arguments row-major.  The outermost length never
+// matters, which is just as well, since it may be the variable one.
+llvm::Value* WriteBarrierPass::elemNumber(llvm::CallInst* const call,
+                                          const LoggedField& field,
+                                          llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int64ty =
+    llvm::Type::getInt64Ty(BB->getContext());
+  llvm::Value* elem = llvm::ConstantInt::get(int64ty, 0, false);
+
+  for(unsigned i = 0; i < field.dims.size(); i++) {
+    llvm::Value* const idx =
+      llvm::CastInst::CreateIntegerCast(call->getArgOperand(i + 1), int64ty,
+                                        false, "", BB);
+
+    if(0 == i)
+      elem = idx;
+    else {
+      llvm::Value* const dim =
+        llvm::ConstantInt::get(int64ty, field.dims[i], false);
+      llvm::Value* const scaled =
+        llvm::BinaryOperator::CreateMul(elem, dim, "", BB);
+
+      elem = llvm::BinaryOperator::CreateAdd(scaled, idx, "", BB);
+    }
+  }
+
+  return elem;
+}
+
+// The card table is biased by the runtime, so this isn't inbounds.
+void WriteBarrierPass::markCard(Context& context,
+                                llvm::Value* const ctx,
+                                llvm::Value* const obj,
+                                llvm::BasicBlock* const BB) {
+  llvm::LLVMContext& C = BB->getContext();
+  llvm::IntegerType* const int64ty = llvm::Type::getInt64Ty(C);
+  llvm::Value* const tableaddr =
+    context.fieldAddr(ctx, context.cardTableIndex(), BB);
+  llvm::Value* const table = new llvm::LoadInst(tableaddr, "", BB);
+  llvm::Value* const addr = new llvm::PtrToIntInst(obj, int64ty, "", BB);
+  llvm::Value* const idx =
+    llvm::BinaryOperator::CreateLShr(addr,
+                                     llvm::ConstantInt::get(int64ty,
+                                                            GCParams::
+                                                            cardShift,
+                                                            false),
+                                     "", BB);
+  llvm::Value* const card =
+    llvm::GetElementPtrInst::Create(table, idx, "", BB);
+
+  new llvm::StoreInst(llvm::ConstantInt::get(llvm::Type::getInt8Ty(C), 0,
+                                             false), card, BB);
+}
+
+// The write log and the mark queue are both bump-allocated buffers
+// in the context:
+//
+//   check: load the cursor and end, branch to slow if full
+//   slow:  call the overflow function, go back to check
+//   fast:  bump the cursor
+//
+// BB ends up as the fast block, where the old cursor is the slot.
+llvm::Value* WriteBarrierPass::bufferSlot(Context& context,
+                                          llvm::Value* const ctx,
+                                          const unsigned curidx,
+                                          const unsigned endidx,
+                                          llvm::Function* const overflow,
+                                          llvm::BasicBlock*& BB) {
+  llvm::Function* const F = BB->getParent();
+  llvm::LLVMContext& C = F->getContext();
+  llvm::IntegerType* const int32ty = llvm::Type::getInt32Ty(C);
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::BasicBlock* const checkBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const slowBB = llvm::BasicBlock::Create(C, "", F);
+  llvm::BasicBlock* const fastBB = llvm::BasicBlock::Create(C, "", F);
+
+  llvm::BranchInst::Create(checkBB, BB);
+
+  llvm::Value* const curaddr = context.fieldAddr(ctx, curidx, checkBB);
+  llvm::Value* const endaddr = context.fieldAddr(ctx, endidx, checkBB);
+  llvm::Value* const cur = new llvm::LoadInst(curaddr, "", checkBB);
+  llvm::Value* const end = new llvm::LoadInst(endaddr, "", checkBB);
+  llvm::Value* const full =
+    new llvm::ICmpInst(*checkBB, llvm::ICmpInst::ICMP_UGE, cur, end);
+  llvm::BranchInst* const br =
+    llvm::BranchInst::Create(slowBB, fastBB, full, checkBB);
+
+  br->setMetadata(llvm::LLVMContext::MD_prof,
+                  llvm::MDBuilder(C).createBranchWeights(1, 1000));
+
+  llvm::Value* const rawctx =
+    llvm::CastInst::CreatePointerCast(ctx, int8ptrty, "", slowBB);
+
+  llvm::CallInst::Create(overflow, rawctx, "", slowBB);
+  llvm::BranchInst::Create(checkBB, slowBB);
+
+  llvm::Value* const one = llvm::ConstantInt::get(int32ty, 1, false);
+  llvm::Value* const next =
+    llvm::GetElementPtrInst::CreateInBounds(cur, one, "", fastBB);
+
+  new llvm::StoreInst(next, curaddr, fastBB);
+  BB = fastBB;
+
+  return cur;
+}
+
+void WriteBarrierPass::appendLog(Context& context,
+                                 Runtime& runtime,
+                                 llvm::Value* const ctx,
+                                 llvm::Value* const obj,
+                                 llvm::CallInst* const call,
+                                 const LoggedField& field,
+                                 llvm::BasicBlock* BB,
+                                 llvm::BasicBlock* const restBB) {
+  llvm::IntegerType* const int32ty =
+    llvm::Type::getInt32Ty(BB->getContext());
+  llvm::Value* const elem = elemNumber(call, field, BB);
+  llvm::Value* const slot =
+    bufferSlot(context, ctx, context.logCurIndex(), context.logEndIndex(),
+               runtime.getLogFull(), BB);
+  llvm::Value* const vals[3] = {
+    obj, llvm::ConstantInt::get(int32ty, field.leaf, false), elem
+  };
+  const unsigned idxs[3] = {
+    Context::logObjIndex, Context::logLeafIndex, Context::logElemIndex
+  };
+
+  for(unsigned i = 0; i < 3; i++) {
+    llvm::Value* const gepidxs[2] = {
+      llvm::ConstantInt::get(int32ty, 0, false),
+      llvm::ConstantInt::get(int32ty, idxs[i], false)
+    };
+    llvm::Value* const addr =
+      llvm::GetElementPtrInst::CreateInBounds(slot, gepidxs, "", BB);
+
+    new llvm::StoreInst(vals[i], addr, BB);
+  }
+
+  llvm::BranchInst::Create(restBB, BB);
+}
+
+// This follows the leaf's path, taking array indexes from the
+// modifier's arguments, in the same order as the modifier does.  With
+// double pointers, the slot for the current heap is the one that gets
+// read.
+llvm::Value* WriteBarrierPass::oldValue(Context& context,
+                                        llvm::Value* const ctx,
+                                        llvm::CallInst* const call,
+                                        const LoggedField& field,
+                                        llvm::BasicBlock* const BB) {
+  llvm::IntegerType* const int32ty =
+    llvm::Type::getInt32Ty(BB->getContext());
+  llvm::SmallVector<llvm::Value*, 8> idxs;
+  unsigned arg = 1;
+
+  if(NULL == field.realty) {
+    fprintf(stderr, "SATB barrier for a type that isn't realized\n");
+    abort();
+  }
+
+  llvm::Value* const obj =
+    llvm::CastInst::CreatePointerCast(call->getArgOperand(0),
+                                      field.realty->getPointerTo(), "", BB);
+
+  for(unsigned i = 0; i < field.path.size(); i++)
+    if(field.path[i].array)
+      idxs.push_back(call->getArgOperand(arg++));
+    else
+      idxs.push_back(llvm::ConstantInt::get(int32ty, field.path[i].idx,
+                                            false));
+
+  llvm::Value* addr =
+    llvm::GetElementPtrInst::CreateInBounds(obj, idxs, "", BB);
+
+  if(params.doublePtrs)
+    addr = context.heapSlotAddr(ctx, addr, BB);
+
+  return new llvm::LoadInst(addr, "", BB);
+}
+
+// The call's block gets split before the call, and the barrier goes
+// in between:
+//
+//   head:  load the context and the marking flag, skip if inactive
+//   old:   load the old value, skip if null
+//   fast:  add the old value to the mark queue, go on to the call
+void WriteBarrierPass::insertSATB(Context& context,
+                                  Runtime& runtime,
+                                  llvm::CallInst* const call,
+                                  const LoggedField& field) {
+  llvm::BasicBlock* const headBB = call->getParent();
+  llvm::Function* const F = headBB->getParent();
+  llvm::LLVMContext& C = F->getContext();
+  llvm::Type* const int8ptrty = llvm::Type::getInt8PtrTy(C);
+  llvm::BasicBlock* const restBB = headBB->splitBasicBlock(call);
+  llvm::BasicBlock* BB = llvm::BasicBlock::Create(C, "", F, restBB);
+
+  headBB->getTerminator()->eraseFromParent();
+
+  llvm::Value* const ctx =
+    new llvm::LoadInst(context.getCurrent(), "", headBB);
+  llvm::Value* const flagaddr =
+    context.fieldAddr(ctx, context.markingIndex(), headBB);
+  llvm::Value* const flag = new llvm::LoadInst(flagaddr, "", headBB);
+  llvm::Value* const active =
+    new llvm::ICmpInst(*headBB, llvm::ICmpInst::ICMP_NE, flag,
+                       llvm::ConstantInt::get(flag->getType(), 0, false));
+
+  llvm::BranchInst::Create(BB, restBB, active, headBB);
+
+  llvm::Value* const old = oldValue(context, ctx, call, field, BB);
+  llvm::Value* const isnull =
+    new llvm::ICmpInst(*BB, llvm::ICmpInst::ICMP_EQ, old,
+                       llvm::ConstantPointerNull::get(
+                         llvm::cast<llvm::PointerType>(old->getType())));
+  llvm::BasicBlock* const pushBB = llvm::BasicBlock::Create(C, "", F, restBB);
+
+  llvm::BranchInst::Create(restBB, pushBB, isnull, BB);
+  BB = pushBB;
+
+  llvm::Value* const slot =
+    bufferSlot(context, ctx, context.markCurIndex(), context.markEndIndex(),
+               runtime.getMarkFull(), BB);
+
+  new llvm::StoreInst(llvm::CastInst::CreatePointerCast(old, int8ptrty,
+                                                        "", BB),
+                      slot, BB);
+  llvm::BranchInst::Create(restBB, BB);
+}
+
+// The call's block gets split after the call, and the barriers go in
+// between, sharing the object and context.
+void WriteBarrierPass::insertBarrier(Context& context,
+                                     Runtime& runtime,
+                                     llvm::CallInst* const call,
+                                     const LoggedField& field,
+                                     const bool log) {
+  llvm::BasicBlock* const headBB = call->getParent();
+  llvm::Type* const int8ptrty =
+    llvm::Type::getInt8PtrTy(headBB->getContext());
+  llvm::BasicBlock* const restBB =
+    headBB->splitBasicBlock(call->getNextNode());
+
+  headBB->getTerminator()->eraseFromParent();
+
+  llvm::Value* const obj =
+    llvm::CastInst::CreatePointerCast(call->getArgOperand(0), int8ptrty,
+                                      "", headBB);
+  llvm::Value* const ctx =
+    new llvm::LoadInst(context.getCurrent(), "", headBB);
+
+  if(params.cardMarking && field.gcptr)
+    markCard(context, ctx, obj, headBB);
+
+  if(params.writeLogging && log)
+    appendLog(context, runtime, ctx, obj, call, field, headBB, restBB);
+  else
+    llvm::BranchInst::Create(restBB, headBB);
+}
+
+void WriteBarrierPass::getAnalysisUsage(llvm::AnalysisUsage& AU) const {
+  AU.addRequired<ParseMetadataPass>();
+}
+
+// A modifier is a single store, so it can't unwind, and an invoke of
+// one is just a call followed by a branch to the normal destination.
+// Rewriting it that way puts the barriers on the normal edge, and
+// lets the elision analysis treat it like any other call.
+static llvm::CallInst* invokeToCall(llvm::InvokeInst* const invoke) {
+  llvm::SmallVector<llvm::Value*, 4> args;
+
+  for(unsigned i = 0; i < invoke->getNumArgOperands(); i++)
+    args.push_back(invoke->getArgOperand(i));
+
+  llvm::CallInst* const call =
+    llvm::CallInst::Create(invoke->getCalledValue(), args, "", invoke);
+
+  call->takeName(invoke);
+  call->setCallingConv(invoke->getCallingConv());
+  call->setAttributes(invoke->getAttributes());
+  call->setDebugLoc(invoke->getDebugLoc());
+  invoke->replaceAllUsesWith(call);
+  llvm::BranchInst::Create(invoke->getNormalDest(), invoke);
+  invoke->getUnwindDest()->removePredecessor(invoke->getParent());
+  invoke->eraseFromParent();
+
+  return call;
+}
+
+// Collect the calls first, since inserting barriers splits blocks.
+// Invokes of modifiers get turned into calls before that, so that
+// they're found along with the rest.
+bool WriteBarrierPass::runOnModule(llvm::Module& M) {
+  if(!params.writeLogging && !params.cardMarking && !params.satbBarriers)
+    return false;
+
+  Context context(M, params);
+  Runtime runtime(M);
+  llvm::SmallPtrSet<llvm::Function*, 16> funcs;
+  llvm::SmallPtrSet<const llvm::CallInst*, 32> elided;
+  llvm::SmallPtrSet<const llvm::CallInst*, 32> unlogged;
+  std::vector<llvm::InvokeInst*> invokes;
+  std::vector<llvm::CallInst*> calls;
+
+  fields.clear();
+  accessors.clear();
+  allocators.clear();
+  findFields(M, getAnalysis<ParseMetadataPass>().GenTypes);
+
+  if(NULL != M.getFunction("core.gc.rawalloc"))
+    allocators.insert(M.getFunction("core.gc.rawalloc"));
+
+  for(llvm::DenseMap<const llvm::Function*, LoggedField>::iterator it =
+        fields.begin(); it != fields.end(); it++)
+    for(llvm::Value::const_user_iterator u = it->first->user_begin();
+        u != it->first->user_end(); u++) {
+      llvm::InvokeInst* const invoke =
+        llvm::dyn_cast<llvm::InvokeInst>(const_cast<llvm::User*>(*u));
+
+      if(NULL != invoke && it->first == invoke->getCalledFunction())
+        invokes.push_back(invoke);
+    }
+
+  for(unsigned i = 0; i < invokes.size(); i++)
+    invokeToCall(invokes[i]);
+
+  for(llvm::DenseMap<const llvm::Function*, LoggedField>::iterator it =
+        fields.begin(); it != fields.end(); it++)
+    for(llvm::Value::const_user_iterator u = it->first->user_begin();
+        u != it->first->user_end(); u++) {
+      llvm::CallInst* const call =
+        llvm::dyn_cast<llvm::CallInst>(const_cast<llvm::User*>(*u));
+
+      if(NULL != call && it->first == call->getCalledFunction()) {
+        calls.push_back(call);
+
+        if(funcs.insert(call->getParent()->getParent()).second)
+          findElided(*call->getParent()->getParent(), elided, unlogged);
+      }
+    }
+
+  for(unsigned i = 0; i < calls.size(); i++) {
+    const LoggedField& field = fields[calls[i]->getCalledFunction()];
+    const bool log = !unlogged.count(calls[i]);
+
+    if(elided.count(calls[i]))
+      continue;
+
+    if(params.satbBarriers && field.gcptr && log)
+      insertSATB(context, runtime, calls[i], field);
+
+    if((params.writeLogging && log) || (params.cardMarking && field.gcptr))
+      insertBarrier(context, runtime, calls[i], field, log);
+  }
+
+  return !calls.empty();
+}
@@ -17,6 +17,7 @@
  */
 
 #include "GCParams.h"
+#include "llvm/Support/CommandLine.h"
 #include <gtest/gtest.h>
 
 
@@ -37,6 +38,23 @@ TEST(GCParams, testGCParams) {
                      false, false, true, false);
   GCParams traceFuncs(false, false, false, false,
                       false, false, false, true);
+  GCParams compactHeaders(false, false, false, false,
+                          false, false, false, false, true);
+  GCParams inlineFields(false, false, false, false,
+                        false, false, false, false, false, true);
+  GCParams prefetchDistance(false, false, false, false, false,
+                            false, false, false, false, false, 8);
+  GCParams parallelCopy(false, false, false, false, false,
+                        true, false, false, false, false, 0, true);
+  GCParams cardMarking(false, false, false, true, false,
+                       false, false, true, false, false, 0, false, true);
+  GCParams satbBarriers(false, false, false, false, false, false,
+                        false, true, false, false, 0, false, false, true);
+  GCParams pollStride(false, false, false, false, false, false, false,
+                      false, false, false, 0, false, false, false, 64);
+  GCParams safepointBudget(false, false, false, false, false, false,
+                           false, false, false, false, 0, false, false,
+                           false, 0, 100);
   EXPECT_TRUE(writeLogging.writeLogging);
   EXPECT_TRUE(readBarriers.readBarriers);
   EXPECT_TRUE(clusterize.clusterize);
@@ -45,4 +63,44 @@ TEST(GCParams, testGCParams) {
   EXPECT_TRUE(copyFuncs.copyFuncs);
   EXPECT_TRUE(moveFuncs.moveFuncs);
   EXPECT_TRUE(traceFuncs.traceFuncs);
+  EXPECT_TRUE(compactHeaders.compactHeaders);
+  EXPECT_FALSE(traceFuncs.compactHeaders);
+  EXPECT_TRUE(inlineFields.inlineFields);
+  EXPECT_FALSE(traceFuncs.inlineFields);
+  EXPECT_EQ(8u, prefetchDistance.prefetchDistance);
+  EXPECT_EQ(0u, traceFuncs.prefetchDistance);
+  EXPECT_TRUE(parallelCopy.parallelCopy);
+  EXPECT_FALSE(copyFuncs.parallelCopy);
+  EXPECT_TRUE(cardMarking.cardMarking);
+  EXPECT_FALSE(generational.cardMarking);
+  EXPECT_TRUE(satbBarriers.satbBarriers);
+  EXPECT_FALSE(traceFuncs.satbBarriers);
+  EXPECT_EQ(64u, pollStride.pollStride);
+  EXPECT_EQ(0u, traceFuncs.pollStride);
+  EXPECT_EQ(100u, safepointBudget.safepointBudget);
+  EXPECT_EQ(0u, traceFuncs.safepointBudget);
+}
+
+TEST(GCParams, testPollStridePow2) {
+  EXPECT_DEBUG_DEATH(GCParams(false, false, false, false, false, false,
+                              false, false, false, false, 0, false, false,
+                              false, 48),
+                     "power of two");
+}
+
+TEST(GCParams, testFromFlags) {
+  const char* const argv[3] = {
+    "unit_test", "-core-gc-write-logging", "-core-gc-poll-stride=16"
+  };
+
+  llvm::cl::ParseCommandLineOptions(3, argv);
+
+  const GCParams& params = GCParams::fromFlags();
+
+  EXPECT_TRUE(params.writeLogging);
+  EXPECT_FALSE(params.readBarriers);
+  EXPECT_FALSE(params.satbBarriers);
+  EXPECT_EQ(16u, params.pollStride);
+  EXPECT_EQ(0u, params.safepointBudget);
+  EXPECT_EQ(&params, &GCParams::fromFlags());
 }
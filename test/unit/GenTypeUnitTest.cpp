@@ -1200,6 +1200,107 @@ TEST(GenType, test_ArrayGenType_get) {
             llvm::Type::getInt32Ty(ctx));
 }
 
+static llvm::Metadata* const mutunsizedarrayfieldvals[2] = {
+  llvm::ConstantAsMetadata::get(mutabletag),
+  unsizedarrmd
+};
+static llvm::MDNode* const mutunsizedarrayfieldmd =
+  llvm::MDNode::get(ctx,
+                    llvm::ArrayRef<llvm::Metadata*>(mutunsizedarrayfieldvals));
+static llvm::Metadata* const structtrailingvals[4] = {
+  llvm::ConstantAsMetadata::get(structtag),
+  llvm::ConstantAsMetadata::get(constfalse),
+  immint32fieldmd,
+  mutunsizedarrayfieldmd
+};
+static llvm::MDNode* const structtrailingmd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(structtrailingvals));
+
+TEST(GenType, test_GenType_isVariableSized) {
+  const GenType* const unsizedgot =
+    GenType::get(mod, unsizedarrmd, TYPE_MUT_MUTABLE);
+  const GenType* const sizedgot =
+    GenType::get(mod, sizedarrmd, TYPE_MUT_MUTABLE);
+  const GenType* const structgot =
+    GenType::get(mod, structnormmd, TYPE_MUT_MUTABLE);
+  const GenType* const trailinggot =
+    GenType::get(mod, structtrailingmd, TYPE_MUT_MUTABLE);
+
+  EXPECT_TRUE(unsizedgot->isVariableSized());
+  EXPECT_FALSE(sizedgot->isVariableSized());
+  EXPECT_FALSE(structgot->isVariableSized());
+  EXPECT_TRUE(trailinggot->isVariableSized());
+  EXPECT_FALSE(unittype->isVariableSized());
+}
+
+static llvm::Metadata* const structflatvals[4] = {
+  llvm::ConstantAsMetadata::get(structtag),
+  llvm::ConstantAsMetadata::get(constfalse),
+  immint32fieldmd,
+  wonativeptrfieldmd
+};
+static llvm::MDNode* const structflatmd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(structflatvals));
+static llvm::Metadata* const soaarrvals[4] = {
+  llvm::ConstantAsMetadata::get(arrtag),
+  structflatmd,
+  llvm::ConstantAsMetadata::get(const16),
+  llvm::ConstantAsMetadata::get(const1)
+};
+static llvm::MDNode* const soaarrmd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(soaarrvals));
+
+TEST(GenType, test_ArrayGenType_get_layout) {
+  const ArrayGenType* const soatype =
+    ArrayGenType::get(mod, soaarrmd, GenType::Mutable);
+  const ArrayGenType* const aostype =
+    ArrayGenType::get(mod, sizedarrmd, GenType::Mutable);
+
+  EXPECT_EQ(soatype->getLayout(), ArrayGenType::SoA);
+  EXPECT_TRUE(soatype->isSized());
+  EXPECT_EQ(soatype->getNumElems(), 16);
+  EXPECT_EQ(soatype->getElemTy()->getTypeID(), GenType::StructTypeID);
+  EXPECT_EQ(aostype->getLayout(), ArrayGenType::AoS);
+}
+
+static llvm::Metadata* const structgcptrvals[4] = {
+  llvm::ConstantAsMetadata::get(structtag),
+  llvm::ConstantAsMetadata::get(constfalse),
+  immint32fieldmd,
+  mutgcptrfieldmd
+};
+static llvm::MDNode* const structgcptrmd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(structgcptrvals));
+static llvm::Metadata* const gcptrarrvals[3] = {
+  llvm::ConstantAsMetadata::get(arrtag),
+  structgcptrmd,
+  llvm::ConstantAsMetadata::get(const16)
+};
+static llvm::MDNode* const gcptrarrmd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(gcptrarrvals));
+
+TEST(GenType, test_GenType_hasGCPtrs) {
+  const GenType* const arrgot =
+    GenType::get(mod, sizedarrmd, TYPE_MUT_MUTABLE);
+  const GenType* const structgot =
+    GenType::get(mod, structnormmd, TYPE_MUT_MUTABLE);
+  const GenType* const gcptrgot =
+    GenType::get(mod, gcptrstrongmd, TYPE_MUT_MUTABLE);
+  const GenType* const structgcptrgot =
+    GenType::get(mod, structgcptrmd, TYPE_MUT_MUTABLE);
+  const GenType* const gcptrarrgot =
+    GenType::get(mod, gcptrarrmd, TYPE_MUT_MUTABLE);
+
+  EXPECT_FALSE(arrgot->hasGCPtrs());
+  EXPECT_FALSE(structgot->hasGCPtrs());
+  EXPECT_FALSE(unittype->hasGCPtrs());
+  EXPECT_TRUE(gcptrgot->hasGCPtrs());
+  EXPECT_TRUE(structgcptrgot->hasGCPtrs());
+  EXPECT_TRUE(gcptrarrgot->hasGCPtrs());
+  // Ask again, to get the cached result
+  EXPECT_TRUE(gcptrarrgot->hasGCPtrs());
+}
+
 TEST(GenType, test_NativePtrGenType_get) {
   const NativePtrGenType* const immtype =
     NativePtrGenType::get(mod, nativeptrmd, GenType::Immutable);
@@ -1409,6 +1510,32 @@ TEST(GenType, test_GCPtrGenType_get_immobile) {
   EXPECT_EQ(wotype->getTypeID(), GenType::GCPtrTypeID);
 }
 
+static llvm::Metadata* const gcptruniquevals[5] = {
+  llvm::ConstantAsMetadata::get(gcptrtag),
+  llvm::ConstantAsMetadata::get(mobiletag),
+  llvm::ConstantAsMetadata::get(strongtag),
+  tynamemd,
+  llvm::ConstantAsMetadata::get(
+    llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), PTR_OWN_UNIQUE))
+};
+static llvm::MDNode* const gcptruniquemd =
+  llvm::MDNode::get(ctx, llvm::ArrayRef<llvm::Metadata*>(gcptruniquevals));
+
+TEST(GenType, test_GCPtrGenType_get_unique) {
+  const GCPtrGenType* const immtype =
+    GCPtrGenType::get(mod, gcptruniquemd, GenType::Immutable);
+  const GCPtrGenType* const sharedtype =
+    GCPtrGenType::get(mod, gcptrstrongmd, GenType::Immutable);
+
+  EXPECT_EQ(immtype->getElemTy(), opaquetype);
+  EXPECT_EQ(immtype->getOwnership(), GCPtrGenType::Unique);
+  EXPECT_EQ(immtype->mutability(), GenType::Immutable);
+  EXPECT_EQ(immtype->getAccessFunc(), (llvm::Function*)NULL);
+  EXPECT_EQ(immtype->getModifyFunc(), (llvm::Function*)NULL);
+  EXPECT_EQ(sharedtype->getOwnership(), GCPtrGenType::Shared);
+  EXPECT_TRUE(*immtype != *sharedtype);
+}
+
 TEST(GenType, test_GenType_get_GCPtr_strong) {
   const GenType* const immtype =
     GenType::get(mod, gcptrstrongmd, TYPE_MUT_IMMUTABLE);
@@ -1771,6 +1898,15 @@ TEST(GenType, test_StructGenType_accept_nested) {
   visitor.finish();
 }
 
+TEST(GenType, test_StructGenType_get_field_mutability) {
+  const StructGenType* const type =
+    StructGenType::get(mod, structnormmd, GenType::Mutable);
+
+  EXPECT_EQ(type->fieldTy(0)->mutability(), GenType::Immutable);
+  EXPECT_EQ(type->fieldTy(1)->mutability(), GenType::WriteOnce);
+  EXPECT_EQ(type->fieldTy(2)->mutability(), GenType::Mutable);
+}
+
 TEST(GenType, test_FuncPtrGenType_accept_nodescend) {
   const FuncPtrGenType* const type =
     FuncPtrGenType::get(mod, funczeroargmd, GenType::Mutable);
@@ -0,0 +1,163 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "GCParams.h"
+#include "RedundantSafepointPass.h"
+#include "Runtime.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include <gtest/gtest.h>
+
+static llvm::LLVMContext ctx;
+static llvm::Module mod(llvm::StringRef("Test"), ctx);
+static const GCParams params(false, false, false, false, false, false,
+                             false, false, false, false, 0, false, false,
+                             false, 0, 4);
+static llvm::Function* const safepoint = Runtime(mod).getSafepoint();
+static llvm::FunctionType* const functy =
+  llvm::cast<llvm::FunctionType>(safepoint->getType()->getElementType());
+
+static llvm::Function* makeFunc(const char* const name,
+                                llvm::BasicBlock*& BB) {
+  llvm::Function* const F =
+    llvm::Function::Create(functy, llvm::GlobalValue::ExternalLinkage,
+                           name, &mod);
+
+  BB = llvm::BasicBlock::Create(ctx, "", F);
+
+  return F;
+}
+
+static void addSafepoint(llvm::Function* const F,
+                         llvm::BasicBlock* const BB) {
+  llvm::Value* const args[1] = { &*F->arg_begin() };
+
+  llvm::CallInst::Create(safepoint, args, "", BB);
+}
+
+static void addWork(const unsigned n, llvm::BasicBlock* const BB) {
+  llvm::Constant* const one =
+    llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), 1, false);
+
+  for(unsigned i = 0; i < n; i++)
+    llvm::BinaryOperator::CreateAdd(one, one, "", BB);
+}
+
+static unsigned countSafepoints(llvm::Function* const F) {
+  unsigned count = 0;
+
+  for(llvm::Function::iterator BB = F->begin(); BB != F->end(); BB++)
+    for(llvm::BasicBlock::iterator I = BB->begin(); I != BB->end(); I++)
+      if(llvm::CallInst* const call = llvm::dyn_cast<llvm::CallInst>(I))
+        if(safepoint == call->getCalledFunction())
+          count++;
+
+  return count;
+}
+
+TEST(RedundantSafepointPass, testWithinBudget) {
+  llvm::BasicBlock* BB;
+  llvm::Function* const F = makeFunc("withinBudget", BB);
+  RedundantSafepointPass pass(params);
+
+  addSafepoint(F, BB);
+  addWork(3, BB);
+  addSafepoint(F, BB);
+  llvm::ReturnInst::Create(ctx, BB);
+  EXPECT_TRUE(pass.runOnFunction(*F));
+  EXPECT_EQ(1u, countSafepoints(F));
+}
+
+TEST(RedundantSafepointPass, testOverBudget) {
+  llvm::BasicBlock* BB;
+  llvm::Function* const F = makeFunc("overBudget", BB);
+  RedundantSafepointPass pass(params);
+
+  addSafepoint(F, BB);
+  addWork(4, BB);
+  addSafepoint(F, BB);
+  llvm::ReturnInst::Create(ctx, BB);
+  EXPECT_FALSE(pass.runOnFunction(*F));
+  EXPECT_EQ(2u, countSafepoints(F));
+}
+
+TEST(RedundantSafepointPass, testAcrossPredecessor) {
+  llvm::BasicBlock* BB;
+  llvm::Function* const F = makeFunc("acrossPredecessor", BB);
+  llvm::BasicBlock* const nextBB = llvm::BasicBlock::Create(ctx, "", F);
+  RedundantSafepointPass pass(params);
+
+  addSafepoint(F, BB);
+  llvm::BranchInst::Create(nextBB, BB);
+  addSafepoint(F, nextBB);
+  llvm::ReturnInst::Create(ctx, nextBB);
+  EXPECT_TRUE(pass.runOnFunction(*F));
+  EXPECT_EQ(1u, countSafepoints(F));
+}
+
+// A GC function might not poll on entry, so calling one is no
+// safepoint, and it stops the search like any other call.
+TEST(RedundantSafepointPass, testGCCallee) {
+  llvm::BasicBlock* BB;
+  llvm::Function* const F = makeFunc("gcCaller", BB);
+  llvm::BasicBlock* calleeBB;
+  llvm::Function* const callee = makeFunc("gcCallee", calleeBB);
+  llvm::Value* const args[1] = { &*F->arg_begin() };
+  RedundantSafepointPass pass(params);
+
+  callee->setGC("shadow-stack");
+  llvm::ReturnInst::Create(ctx, calleeBB);
+  llvm::CallInst::Create(callee, args, "", BB);
+  addSafepoint(F, BB);
+  llvm::ReturnInst::Create(ctx, BB);
+  EXPECT_FALSE(pass.runOnFunction(*F));
+  EXPECT_EQ(1u, countSafepoints(F));
+}
+
+TEST(RedundantSafepointPass, testDebugInfo) {
+  llvm::BasicBlock* BB;
+  llvm::Function* const F = makeFunc("debugInfo", BB);
+  llvm::Function* const dbgvalue =
+    llvm::Intrinsic::getDeclaration(&mod, llvm::Intrinsic::dbg_value);
+  llvm::Value* const md =
+    llvm::MetadataAsValue::get(ctx, llvm::MDNode::get(ctx, llvm::None));
+  llvm::Value* const args[4] = {
+    md, llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), 0, false),
+    md, md
+  };
+  RedundantSafepointPass pass(params);
+
+  addSafepoint(F, BB);
+
+  for(unsigned i = 0; i < 8; i++)
+    llvm::CallInst::Create(dbgvalue, args, "", BB);
+
+  addSafepoint(F, BB);
+  llvm::ReturnInst::Create(ctx, BB);
+  EXPECT_TRUE(pass.runOnFunction(*F));
+  EXPECT_EQ(1u, countSafepoints(F));
+}
@@ -0,0 +1,115 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "Context.h"
+#include "GCParams.h"
+#include "TraceGenerator.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <gtest/gtest.h>
+
+static llvm::LLVMContext ctx;
+static const GCParams params(true, false, false, false, false, false,
+                             false, false);
+
+// Find the log entry field that a comparison looks at.
+static unsigned keyIndex(const llvm::ICmpInst* const cmp) {
+  const llvm::Value* key = cmp->getOperand(0);
+
+  if(const llvm::PtrToIntInst* const cast =
+     llvm::dyn_cast<llvm::PtrToIntInst>(key))
+    key = cast->getOperand(0);
+
+  const llvm::GetElementPtrInst* const gep =
+    llvm::cast<llvm::GetElementPtrInst>(
+      llvm::cast<llvm::LoadInst>(key)->getPointerOperand());
+
+  return llvm::cast<llvm::ConstantInt>(gep->getOperand(2))->getZExtValue();
+}
+
+// Each key gets a pair of selects, the first giving -1 when a is
+// smaller, and the second 1 when a is bigger, or else falling
+// through to the next key.
+TEST(SyncCodeGen, testCompareKeyOrder) {
+  llvm::Module M(llvm::StringRef("Test"), ctx);
+  SyncCodeGen syncs(M, params);
+  const unsigned keys[3] = {
+    Context::logObjIndex, Context::logLeafIndex, Context::logElemIndex
+  };
+
+  syncs.generateCompact();
+
+  const llvm::Function* const F = M.getFunction("core.gc.logentry.cmp");
+
+  ASSERT_TRUE(NULL != F);
+
+  const llvm::ReturnInst* const ret =
+    llvm::cast<llvm::ReturnInst>(F->back().getTerminator());
+  const llvm::Value* result = ret->getReturnValue();
+
+  for(unsigned i = 0; i < 3; i++) {
+    const llvm::SelectInst* const lt = llvm::cast<llvm::SelectInst>(result);
+    const llvm::SelectInst* const gt =
+      llvm::cast<llvm::SelectInst>(lt->getFalseValue());
+    const llvm::ICmpInst* const ltcmp =
+      llvm::cast<llvm::ICmpInst>(lt->getCondition());
+    const llvm::ICmpInst* const gtcmp =
+      llvm::cast<llvm::ICmpInst>(gt->getCondition());
+
+    EXPECT_EQ(llvm::ICmpInst::ICMP_ULT, ltcmp->getPredicate());
+    EXPECT_EQ(keys[i], keyIndex(ltcmp));
+    EXPECT_TRUE(
+      llvm::cast<llvm::ConstantInt>(lt->getTrueValue())->isMinusOne());
+    EXPECT_EQ(llvm::ICmpInst::ICMP_UGT, gtcmp->getPredicate());
+    EXPECT_EQ(keys[i], keyIndex(gtcmp));
+    EXPECT_TRUE(llvm::cast<llvm::ConstantInt>(gt->getTrueValue())->isOne());
+    result = gt->getFalseValue();
+  }
+
+  EXPECT_TRUE(llvm::cast<llvm::ConstantInt>(result)->isZero());
+}
+
+// Compaction runs during the pause, so it shouldn't call out to
+// anything, let alone through a pointer.
+TEST(SyncCodeGen, testCompactSelfContained) {
+  llvm::Module M(llvm::StringRef("Test"), ctx);
+  SyncCodeGen syncs(M, params);
+  const llvm::Function* const F = syncs.generateCompact();
+  const llvm::Function* const siftdown =
+    M.getFunction("core.gc.logentry.siftdown");
+  const llvm::Function* const funcs[2] = { F, siftdown };
+
+  ASSERT_TRUE(NULL != siftdown);
+  EXPECT_TRUE(NULL == M.getFunction("qsort"));
+
+  for(unsigned i = 0; i < 2; i++)
+    for(llvm::Function::const_iterator BB = funcs[i]->begin();
+        BB != funcs[i]->end(); BB++)
+      for(llvm::BasicBlock::const_iterator I = BB->begin();
+          I != BB->end(); I++)
+        if(const llvm::CallInst* const call =
+           llvm::dyn_cast<llvm::CallInst>(I)) {
+          ASSERT_TRUE(NULL != call->getCalledFunction());
+          EXPECT_FALSE(call->getCalledFunction()->isDeclaration());
+        }
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2013 Eric McCorkle.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#define __STDC_LIMIT_MACROS 1
+#define __STDC_CONSTANT_MACROS 1
+#include "GCParams.h"
+#include "WriteBarrierPass.h"
+#include "ParseMetadataPass.h"
+#include "metadata.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include <gtest/gtest.h>
+
+static llvm::LLVMContext ctx;
+static const GCParams params(true, false, false, false, false, false,
+                             false, false);
+static llvm::Constant* const structtag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), GEN_TYPE_STRUCT);
+static llvm::Constant* const gcptrtag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), GEN_TYPE_GCPTR);
+static llvm::Constant* const inttag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), GEN_TYPE_INT);
+static llvm::Constant* const mobiletag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), PTR_MOB_MOBILE);
+static llvm::Constant* const strongtag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), PTRCLASS_STRONG);
+static llvm::Constant* const sharedtag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), PTR_OWN_SHARED);
+static llvm::Constant* const mutabletag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), TYPE_MUT_MUTABLE);
+static llvm::Constant* const immutabletag =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), TYPE_MUT_IMMUTABLE);
+static llvm::Constant* const constfalse =
+  llvm::ConstantInt::get(llvm::Type::getInt1Ty(ctx), 0);
+static llvm::Constant* const const32 =
+  llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), 32);
+
+static llvm::MDNode* field(llvm::Constant* const mut,
+                           llvm::Metadata* const ty) {
+  llvm::Metadata* const vals[2] = { llvm::ConstantAsMetadata::get(mut), ty };
+
+  return llvm::MDNode::get(ctx, vals);
+}
+
+static void addType(llvm::Module& M,
+                    const char* const name,
+                    llvm::ArrayRef<llvm::Metadata*> fields) {
+  llvm::SmallVector<llvm::Metadata*, 4> descvals;
+
+  descvals.push_back(llvm::ConstantAsMetadata::get(structtag));
+  descvals.push_back(llvm::ConstantAsMetadata::get(constfalse));
+  descvals.append(fields.begin(), fields.end());
+
+  llvm::Metadata* const vals[3] = {
+    llvm::MDString::get(ctx, name),
+    llvm::ConstantAsMetadata::get(mutabletag),
+    llvm::MDNode::get(ctx, descvals)
+  };
+
+  M.getOrInsertNamedMetadata("core.gc.types")->addOperand(
+    llvm::MDNode::get(ctx, vals));
+}
+
+// The pointer is leaf 0 in one type and leaf 1 in the other, so one
+// modifier can't be right for both.
+TEST(WriteBarrierPass, testSharedModifier) {
+  llvm::Module M(llvm::StringRef("Test"), ctx);
+  llvm::Type* const opaquety = llvm::StructType::create(ctx, "obj");
+  llvm::Type* const argtys[2] = {
+    llvm::Type::getInt8PtrTy(ctx), opaquety->getPointerTo()
+  };
+  llvm::Function* const getter =
+    llvm::Function::Create(llvm::FunctionType::get(opaquety->getPointerTo(),
+                                                   argtys[0], false),
+                           llvm::GlobalValue::ExternalLinkage, "get", &M);
+  llvm::Function* const setter =
+    llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(ctx),
+                                                   argtys, false),
+                           llvm::GlobalValue::ExternalLinkage, "set", &M);
+  llvm::Metadata* const gcptrvals[7] = {
+    llvm::ConstantAsMetadata::get(gcptrtag),
+    llvm::ConstantAsMetadata::get(mobiletag),
+    llvm::ConstantAsMetadata::get(strongtag),
+    llvm::MDString::get(ctx, "obj"),
+    llvm::ConstantAsMetadata::get(sharedtag),
+    llvm::ValueAsMetadata::get(getter),
+    llvm::ValueAsMetadata::get(setter)
+  };
+  llvm::Metadata* const int32vals[2] = {
+    llvm::ConstantAsMetadata::get(inttag),
+    llvm::ConstantAsMetadata::get(const32)
+  };
+  llvm::Metadata* const gcptrfield =
+    field(mutabletag, llvm::MDNode::get(ctx, gcptrvals));
+  llvm::Metadata* const intfield =
+    field(immutabletag, llvm::MDNode::get(ctx, int32vals));
+  llvm::Metadata* const firstfields[1] = { gcptrfield };
+  llvm::Metadata* const secondfields[2] = { intfield, gcptrfield };
+  llvm::legacy::PassManager PM;
+
+  addType(M, "first", firstfields);
+  addType(M, "second", secondfields);
+  PM.add(new ParseMetadataPass());
+  PM.add(new WriteBarrierPass(params));
+  EXPECT_DEATH(PM.run(M), "Modifier set writes different fields");
+}